@@ -2,10 +2,11 @@
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <cstdint>
 
 using namespace std;
 
-#ifndef SIGNUM(x)
+#ifndef SIGNUM
 #define SIGNUM(x) (x == 0 ? 0 : (x < 0 ? -1 : 1))
 #endif
 
@@ -21,36 +22,28 @@ using namespace std;
 // 3. cross product
 // 4. norm
 // 5. vector triple product of the form (A X B) X C
+// MEMO the cached norm went stale after scale/+=/-= and was never filled in anyway
+// (the sentinel was 0, not -1), so it is computed on demand now
 struct point {
 
-private:
-	double _norm = 0;
-	double _inv_norm = 0;
-
-public:
 	double x;
 	double y;
 
+	point(){this->x = 0; this->y = 0;}
+
 	point(double x, double y){this->x = x; this->y = y;}
 
-	point(point &p){
+	point(const point &p){
 		this->x = p.x;
 		this->y = p.y;
 	}
 
 	double inv_norm(){
-		if(_inv_norm != -1){
-			return _inv_norm;
-		}
 		return 1.0/this->norm();
 	}
 
 	double norm(){
-		if(_norm!=-1){
-			return _norm;
-		}
-		this->_norm = sqrt(this->x*this->x + this->y*this->y);
-		return _norm;
+		return sqrt(this->x*this->x + this->y*this->y);
 	}
 
 	// the (ingenious) algorithm from Quake 3
@@ -85,56 +78,60 @@ public:
 	}
 
 	// 2d cross product
-	double cross(point &p2){
+	double cross(const point &p2) const {
 		return this->x*p2.y - this->y*p2.x;
 	}
 
 	// dot product
-	double dot(point p1, point &p2){
-		return p1.x*p2.x + p1.y*p2.y;
+	double dot(const point &p2) const {
+		return this->x*p2.x + this->y*p2.y;
 	}
 
 	// (this X p2) X p3
+	// (A X B) is along z, and z X (x, y) = (-y, x)
 	point& triple_cross(point &p2, point &p3){
 		double a = this->cross(p2);
-		this->x = -a*p3.x;
-		this->y = a*p3.y;
+		this->x = -a*p3.y;
+		this->y = a*p3.x;
 		return *this;
 	}
 
 	//Addition
 	point operator+=(point pnt){ (*this).x += pnt.x; (*this).y += pnt.y; return (*this); }
-	point operator+(point pnt) { return point((*this).x + pnt.x, (*this).y + pnt.y);	}
+	point operator+(const point &pnt) const { return point((*this).x + pnt.x, (*this).y + pnt.y);	}
 
 	//Subtraction
 	point operator-=(point pnt){ (*this).x -= pnt.x; (*this).y -= pnt.y; return (*this); }
-	point operator-(point pnt) { return point((*this).x - pnt.x, (*this).y - pnt.y); }
+	point operator-(const point &pnt) const { return point((*this).x - pnt.x, (*this).y - pnt.y); }
 
 	//Multiplication
 	point operator*=(float num){ (*this).x *= num; (*this).y *= num; return (*this); }
-	point operator*(float num) { return point((*this).x * num, (*this).y * num); }
+	point operator*(float num) const { return point((*this).x * num, (*this).y * num); }
 
 	//Division
 	point operator/=(float num){ (*this).x /= num; (*this).y /= num; return (*this); }
-	point operator/(float num) { return point((*this).x / num, (*this).y / num); }
+	point operator/(float num) const { return point((*this).x / num, (*this).y / num); }
+
+	//Negation
+	point operator-() const { return point(-(*this).x, -(*this).y); }
 
 	//Equal (Assignment)
-	point operator=(point pnt) { (*this).x = pnt.x; (*this).y = pnt.y; return (*this); }
+	point operator=(const point &pnt) { (*this).x = pnt.x; (*this).y = pnt.y; return (*this); }
 };
 
 // 2d triple product ((A X B) X C)
 // for the other association use unary minus after the operation
-point triple_crossed(point &p1, point &p2, point &p3){
+point triple_crossed(const point &p1, const point &p2, const point &p3){
 	double a = p1.cross(p2);
-	return point(-a*p3.x, a*p3.y);
+	return point(-a*p3.y, a*p3.x);
 }
 
 
-point normalized(point &p){
+point normalized(point p){
 	return point(p.x/p.norm(), p.y/p.norm());
 }
 
-point scaled(point &p, double factor){
+point scaled(const point &p, double factor){
 	return point(p.x*factor, p.y*factor);
 }
 
@@ -142,8 +139,13 @@ point origin() {
 	return point(0.0, 0.0);
 }
 
-int compare_angle(point &p11, point &p12, point &p21, point &p22){
-	return SIGNUM((p12-p11)*(p22-p21));
+int compare_angle(point p11, point p12, point p21, point p22){
+	return SIGNUM((p12-p11).cross(p22-p21));
+}
+
+// same thing for two edge vectors that are already differences
+int compare_angle(const point &e1, const point &e2){
+	return SIGNUM(e1.cross(e2));
 }
 
 // modular increment and decrement for circular array operations
@@ -173,21 +175,25 @@ struct simplex {
 	// use epsilon-bounded checks later
 
 	// MEMO : done rudimentary epsilon cheks and bounding box checks
+	// MEMO : the edge terms have to be crosses (which side of the edge), not dots,
+	//        and the origin is inside when all three agree in sign whatever the winding
 
 	bool contains_origin(){
 
 		// just some bounding box checks
-		if(!(min(p1.x, min(p2.x, p3.x)) <= 0 && max(p1.x, max(p2.x, p3.x)) >=0 && min(p1.y, min(p2.y, p3.y)) >= 0 && max(p1.y, max(p2.y, p3.y)) <= 0)) return false;
+		if(!(min(p1.x, min(p2.x, p3.x)) <= 0 && max(p1.x, max(p2.x, p3.x)) >=0 && min(p1.y, min(p2.y, p3.y)) <= 0 && max(p1.y, max(p2.y, p3.y)) >= 0)) return false;
 
-		double e1 = (p2-p1).dot(p1);
-		double e2 = (p3-p2).dot(p2);
-		double e3 = (p1-p3).dot(p3);
+		double e1 = (p2-p1).cross(-p1);
+		double e2 = (p3-p2).cross(-p2);
+		double e3 = (p1-p3).cross(-p3);
 
-		// TODO not sure about the sign here so try running some tests
 		// epsilon bounds should be tuned
 		if((e1 <= 0 || IN_EPS(e1)) && (e2 <= 0 || IN_EPS(e2)) && (e3 <= 0 || IN_EPS(e3))){
 			return true;
 		}
+		if((e1 >= 0 || IN_EPS(e1)) && (e2 >= 0 || IN_EPS(e2)) && (e3 >= 0 || IN_EPS(e3))){
+			return true;
+		}
 		return false;
 
 	}
@@ -251,11 +257,11 @@ int support_point_fast(vector<point> &polygon, int pos){
 // MEMO keep the log(n) idea on hold maybe O(n) is optimal
 
 int support_point(vector<point> &polygon, int pos){
-	int max_dot = 0;
+	double max_dot = -INFINITY;
 	int sp = 0;
 	double dot = 0;
 	point norm_ref = -normalized(polygon[pos]);
-	for(int i = 0; i<polygon.size(); ++i){
+	for(int i = 0; i<(int)polygon.size(); ++i){
 		if(i == pos){
 			continue;
 		}
@@ -268,15 +274,17 @@ int support_point(vector<point> &polygon, int pos){
 	return sp;
 }
 
-int support_point(vector<point> &polygon, point pt){
+// vertex furthest along pt
+// the vertices are used as is (not normalized), otherwise this is the furthest
+// direction rather than the furthest point. no ordering assumed so any point cloud works
+int support_point(const vector<point> &polygon, const point &pt){
 
 	int sp = 0;
 	double dot = 0;
-	point norm_ref = normalized(pt);
-	double max_dot = 0;
+	double max_dot = -INFINITY;
 
-	for(int i = 0; i<polygon.size(); ++i){
-		dot = normalized(polygon[i]).dot(norm_ref);
+	for(int i = 0; i<(int)polygon.size(); ++i){
+		dot = polygon[i].dot(pt);
 		if(dot > max_dot){
 			sp = i;
 			max_dot = dot;
@@ -294,9 +302,9 @@ vector<point> minkowski_sum(vector<point> &a, vector<point> &b) {
 	//		poX > poY ? Y++ : X++
 
 	int posa = 0;
-	int mnx = a[0].x, mny = a[0].y;
-	for(int i = 0; i<a.size(); ++i) {
-		if(a[i] > mny){
+	double mnx = a[0].x, mny = a[0].y;
+	for(int i = 0; i<(int)a.size(); ++i) {
+		if(a[i].y > mny){
 			continue;
 		}
 		else if(a[i].y < mny) {
@@ -314,7 +322,7 @@ vector<point> minkowski_sum(vector<point> &a, vector<point> &b) {
 	int posb = 0;
 	mnx = b[0].x;
 	mny = b[0].y;
-	for(int i = 0; i<b.size(); ++i) {
+	for(int i = 0; i<(int)b.size(); ++i) {
 		if(b[i].y > mny){
 			continue;
 		}
@@ -352,7 +360,7 @@ vector<point> minkowski_sum(vector<point> &a, vector<point> &b) {
 		}
 		else {
 			i = modinc(i, asz);
-			j = modinc(j, asz);
+			j = modinc(j, bsz);
 		}
 		cnt++;
 	}
@@ -365,7 +373,7 @@ vector<point> minkowski_difference(vector<point> &a, vector<point> &b) {
 	// just sum with all points in b negated
 	vector<point> minus_b = vector<point>(b.size());
 	int i = 0;
-	while(i < b.size()){
+	while(i < (int)b.size()){
 		minus_b[i] = -b[i];
 		++i;
 	}
@@ -373,37 +381,90 @@ vector<point> minkowski_difference(vector<point> &a, vector<point> &b) {
 }
 
 
-bool intersects(vector<point> &pg1, vector<point> &pg2){
+// support point of the minkowski difference pg1 - pg2 along d
+// no need to build the difference explicitly, which also means the shapes
+// can be any point clouds (segments, swept footprints) and not just ordered polygons
+point support(const vector<point> &pg1, const vector<point> &pg2, const point &d){
+	return pg1[support_point(pg1, d)] - pg2[support_point(pg2, -d)];
+}
+
+// MEMO the first version walked a single edge of the explicit minkowski difference
+// and gave up on the first repeated support point. this is the usual simplex
+// refinement: keep the 1 or 2 newest points plus the new support point and
+// search towards the origin from the feature closest to it
+// touching shapes count as intersecting
+
+bool intersects(const vector<point> &pg1, const vector<point> &pg2){
+
+	// any starting direction works, the centroid offset just converges faster
+	point d = pg2[0] - pg1[0];
+	if(IN_EPS(d.x) && IN_EPS(d.y)){
+		d = point(1, 0);
+	}
 
-	vector<point> mnk_diff = minkowski_difference(pg1, pg2);
+	point s[3];
+	int n = 0;
+	s[n++] = support(pg1, pg2, d);
+	d = -s[0];
 
-	// do not instantiate origin for no reason
-	// just use unary minus or scale by -1
-	// if absolutely necessary, use this :
-	point O = origin();
-	// and stop crying about python being better
+	// every iteration strictly moves the simplex towards the origin,
+	// the cap is only there for degenerate input
+	int max_iter = 2*(pg1.size() + pg2.size()) + 8;
 
-	// any random point
-	int p = 0;
-	int sp = support_point(mnk_diff, 0);
-	int pn;
+	for(int it = 0; it<max_iter; ++it) {
 
-	while (true) {
-		point line = polygon[sp] - polygon[p];
-		point perp = normalized(triple_crossed(line, -polygon[p], line));
-		pn = support_point(mnk_diff, perp);
+		if(IN_EPS(d.x) && IN_EPS(d.y)){
+			// origin is on the current feature
+			return true;
+		}
 
-		// support point remains same so we have reached end
-		if(pn == sp || pn == p) {
+		point a = support(pg1, pg2, d);
+		if(a.dot(d) < 0){
+			// could not get past the origin, so it lies outside the difference
 			return false;
 		}
-		else if(simplex(mnk_diff[p], mnk_diff[sp], mnk_diff[pn]).contains_origin()){
+		s[n++] = a;
+
+		point ao = -a;
+		if(n == 2){
+			// line : a is the new point, b the old one
+			point ab = s[0] - a;
+			d = triple_crossed(ab, ao, ab);
+			if(IN_EPS(d.x) && IN_EPS(d.y) && ab.dot(ao) >= 0 && ab.dot(ao) <= ab.dot(ab)){
+				return true;
+			}
+			continue;
+		}
+
+		// triangle : a is the new point, b and c the old ones
+		point b = s[1], c = s[0];
+		point ab = b - a, ac = c - a;
+		point ab_perp = triple_crossed(ac, ab, ab);
+		point ac_perp = triple_crossed(ab, ac, ac);
+
+		if(ab_perp.dot(ao) > 0){
+			// drop c
+			s[0] = b;
+			s[1] = a;
+			n = 2;
+			d = ab_perp;
+		}
+		else if(ac_perp.dot(ao) > 0){
+			// drop b
+			s[1] = a;
+			n = 2;
+			d = ac_perp;
+		}
+		else {
+			// origin is inside the triangle
 			return true;
 		}
-		sp = pn;
 	}
+	return false;
 }
 
+#ifndef GJK_NO_MAIN
+
 int main() {
 	int n1, n2;
 	cout << "Enter number of sides in polygons separated by a [space]" << endl;
@@ -416,16 +477,19 @@ int main() {
 	cout << "Enter points in first polygon in the format x [space] y on the next " << n1 << " lines" << endl;
 	while(i<n1) {
 		cin >> p1[i].x >> p1[i].y;
-		--i;
+		++i;
 	}
 
+	i = 0;
 	cout << "Enter points in second polygon in the format x [space] y on the next " << n2 << " lines" << endl;
 	while(i<n2) {
 		cin >> p2[i].x >> p2[i].y;
-		--i;
+		++i;
 	}
 
 	cout << endl << (intersects(p1, p2) ? "INTERSECTION FOUND" : "NO INTERSECTION") << endl;
 
 	return 0;
-}
\ No newline at end of file
+}
+
+#endif
@@ -4,9 +4,27 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <errno.h>
 
 
 /*
+	build : gcc -O2 -pthread emulator_001.c -o emulator
+	run   : ./emulator <image> [--disasm] [--optimize] [--jit] [--trace off|summary|insn] [--trace-file path]
+	                           [--profile count|sample] [--profile-file path]
+	                                                            flame graph stacks in vm_profile.folded
+	                           [--cache path | --no-cache]      loaded image cached in <image>.vmc
+	                           [--unbuffered]                   PRINT written as it runs, not batched
+	        ./emulator <image> --addr-bits 16|32                16 or 32 bit machine, paged memory
+	        ./emulator <image> --inputs <file> [--threads n] [--lanes | --jit]
+	                                                            one run per line of r0 .. r4 values
+	        ./emulator --batch [--threads n] <image> ...        one run per image
+	        ./emulator --decode-trace <file>
 */
 
 #define NO_FUNCTION 0
@@ -59,6 +77,63 @@ const char *bit_rep[16] = {
     [12] = "1100", [13] = "1101", [14] = "1110", [15] = "1111",
 };
 
+//////////////////////////////////////////////////////////////
+///////////////          TRACING          ////////////////////
+//////////////////////////////////////////////////////////////
+
+// TRACE_SUMMARY counts executed instructions, TRACE_INSN also appends one 32 bit
+// record per instruction (pc, opcode, SP, SZ) to a ring buffer that keeps the last
+// TRACE_RING of them. the ring is written to a file at exit and decoded by --decode-trace
+#define TRACE_OFF		0
+#define TRACE_SUMMARY	1
+#define TRACE_INSN		2
+
+#define TRACE_RING		(1<<16)
+#define TRACE_MAGIC		0x52545656
+#define TRACE_VERSION	1
+
+typedef struct
+{
+	int level;
+	// number of instructions executed, the ring slot of the next record is head % TRACE_RING
+	unsigned long long head;
+	unsigned int *ring;
+	// optional, see PROFILER. it runs on the same hook
+	struct vm_profile *prof;
+} vm_trace;
+
+//////////////////////////////////////////////////////////////
+///////////////        VM CONTEXT         ////////////////////
+//////////////////////////////////////////////////////////////
+
+// everything one machine needs. nothing in the loader or the VM touches globals, so any
+// number of contexts can load and run at the same time
+typedef struct
+{
+	unsigned char RAM[1<<8];
+	// 0x07 : instruction pointer
+	// 0x06 : current stack size
+	// 0x05 : current stack pointer
+	unsigned char reg_bank[8];
+	// start of the code segment
+	unsigned char CS;
+
+	// RAM right after loading, vm_reset goes back to it
+	unsigned char image[1<<8];
+	// highest stack address a run from vm_reset can touch, 0 if unknown. when known it is
+	// below CS and vm_run drops its overflow checks
+	int stack_top;
+
+	// optional
+	vm_trace *trace;
+	// optional native tier, ignored while tracing
+	struct vm_jit *jit;
+
+	// PRINT output, "STDOUT : n" lines on stdout when print is NULL
+	void (*print)(void *user, unsigned char value);
+	void *user;
+} vm_context;
+
 const char *exit_codes[4] = {
 	[0] = "RAM overflow", [1] = "Stack overflow", [2] = "Undefined error", [3] = "Normal",
 };
@@ -100,6 +175,7 @@ unsigned char *map_file(const char *address, off_t *res, int *fp)
     	// Error mapping the file
     	*res = -4;
         close(fd);
+        return NULL;
     }
 
     *fp = fd;
@@ -132,33 +208,156 @@ void print_instruction(unsigned char opcode){
 	return;
 }
 
-unsigned char read_bits(unsigned char *map, int rd_sz, int *pos, int *err)
+//////////////////////////////////////////////////////////////
+///////////////     BIT STREAM READER     ////////////////////
+//////////////////////////////////////////////////////////////
+
+// the image is consumed from its last byte towards its first, each byte least
+// significant bit first, and fields are stored least significant bit first as well.
+// so the stream is just the bytes in reverse order read as one little endian number:
+// the reader keeps up to 64 of those bits in buf and takes fields off the bottom,
+// refilling with one 8 byte load at a time
+
+typedef struct
+{
+	const unsigned char *map;
+	// bytes not yet moved into buf, they are map[0 .. left-1]
+	long long left;
+	unsigned long long buf;
+	int count;
+} bit_reader;
+
+void br_init(bit_reader *br, const unsigned char *map, long long size)
+{
+	br->map = map;
+	br->left = size;
+	br->buf = 0;
+	br->count = 0;
+}
+
+void br_refill(bit_reader *br)
 {
-	if(*pos < rd_sz-1 || rd_sz > 8) {
-		*err = 1;
-		return 0;
+	int take = (63 - br->count) >> 3;
+	if(br->left >= 8)
+	{
+		unsigned long long w;
+		memcpy(&w, br->map + br->left - 8, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		w = __builtin_bswap64(w);
+#endif
+		// map[left-1] is now the low byte
+		br->buf |= (w & ((1ULL << 8*take) - 1)) << br->count;
+		br->count += 8*take;
+		br->left -= take;
+		return;
+	}
+	for(; take > 0 && br->left > 0; --take)
+	{
+		br->buf |= (unsigned long long)br->map[--br->left] << br->count;
+		br->count += 8;
+	}
+}
+
+// takes the next n (at most 32) bits, returns 0 at the end of the image
+int br_read(bit_reader *br, int n, unsigned char *out)
+{
+	if(br->count < n)
+	{
+		br_refill(br);
+		if(br->count < n)
+		{
+			return 0;
+		}
 	}
+	*out = br->buf & ((1ULL << n) - 1);
+	br->buf >>= n;
+	br->count -= n;
+	return 1;
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////    INSTRUCTION LAYOUTS    ////////////////////
+//////////////////////////////////////////////////////////////
+
+// an encoded instruction is a 3 bit opcode, then per operand a kind field followed
+// by a value whose width depends on the kind. in RAM it takes 1 + 2*nargs bytes:
+// opcode, then kind and value of each operand
 
-	unsigned char acc = 0;
-	unsigned int page = *pos/8;
-	unsigned char bit_mask = 1<<(7-*pos%8);
+#define K_CNST	(1<<CNST)
+#define K_RGSTR	(1<<RGSTR)
+#define K_SYMBL	(1<<SYMBL)
+#define K_PNTR	(1<<PNTR)
+#define K_ANY	(K_CNST | K_RGSTR | K_SYMBL | K_PNTR)
+
+typedef struct
+{
+	unsigned char nargs;
+	// width of the kind fields. EQU's is 3 bits in the image format
+	unsigned char kind_width;
+	// kinds accepted by each operand, and how to describe them in errors
+	unsigned char accepts[2];
+	const char *expects[2];
+} insn_layout;
+
+const insn_layout layouts[8] = {
+	[MOV]   = {2, 2, {K_RGSTR | K_SYMBL | K_PNTR, K_ANY}, {"address or pointer type", ""}},
+	[CAL]   = {1, 2, {K_CNST}, {"value type"}},
+	[RET]   = {0, 2},
+	[REF]   = {2, 2, {K_SYMBL, K_RGSTR | K_SYMBL | K_PNTR}, {"SYMBL", "address or pointer type"}},
+	[ADD]   = {2, 2, {K_RGSTR, K_RGSTR}, {"register address", "register address"}},
+	[PRINT] = {1, 2, {K_ANY}},
+	[NOT]   = {1, 2, {K_RGSTR}, {"register address"}},
+	[EQU]   = {1, 3, {K_RGSTR}, {"register address"}},
+};
+
+const unsigned char value_width[4] = {[CNST] = 8, [RGSTR] = 3, [SYMBL] = 5, [PNTR] = 5};
+
+// decodes one instruction into ins (RAM order) and returns its size in bytes
+// illegal operands are reported and flagged in *err but decoding goes on so later
+// errors show up too. returns 0 when the stream cannot be decoded any further
+int read_insn(bit_reader *br, unsigned char *ins, int line_number, int *err)
+{
+	if(!br_read(br, 3, &ins[0]))
+	{
+		printf("L %d : Unexpected end of image\n", line_number);
+		return 0;
+	}
 
-	for(int i = 0; i<rd_sz; ++i)
+	const insn_layout *l = &layouts[ins[0]];
+	int name_len = strcspn(opcodes[ins[0]], " ");
+	for(int k = 0; k<l->nargs; ++k)
 	{
-		if(!bit_mask)
+		unsigned char *kind = &ins[1 + 2*k], *val = &ins[2 + 2*k];
+		if(!br_read(br, l->kind_width, kind))
 		{
-			bit_mask = 1;
-			if(page==0){
-				*err = -1;
-				return 0;
-			}
-			page--;
+			printf("L %d : Unexpected end of image\n", line_number);
+			return 0;
+		}
+		if(*kind > PNTR)
+		{
+			printf("L %d : Unknown arg type %d given to op of type : %.*s\n", line_number, *kind, name_len, opcodes[ins[0]]);
+			return 0;
+		}
+		if(!(l->accepts[k] >> *kind & 1))
+		{
+			printf("L %d : Illegal arg at position %d of type %s given to op of type : %.*s (expected %s)\n",
+				line_number, k + 1, argcodes[*kind], name_len, opcodes[ins[0]], l->expects[k]);
+			*err = -1;
+		}
+		if(!br_read(br, value_width[*kind], val))
+		{
+			printf("L %d : Unexpected end of image\n", line_number);
+			return 0;
 		}
-		acc |= ((map[page]&bit_mask)>0)<<i;
-		bit_mask<<=1;
 	}
-	*pos -= rd_sz;
-	return acc;
+
+	if(ins[0] == CAL && ins[2] > 7)
+	{
+		printf("L %d : Label of function call exceeds maximum value (7)\n", line_number);
+		*err = -1;
+	}
+	return 1 + 2*l->nargs;
 }
 
 
@@ -173,10 +372,10 @@ void print_args(unsigned char argcode, unsigned char argv)
 		printf(" %s %s%d", argcodes[argcode], "0x0", argv);
 		break;
 		case SYMBL:
-		printf(" %s %c   ", argcodes[argcode], stack_symbols[argv]);
+		printf(" %s %c   ", argcodes[argcode], argv < 32 ? stack_symbols[argv] : '?');
 		break;
 		case PNTR:
-		printf(" %s %s%c%s", argcodes[argcode], "[", stack_symbols[argv], "]");
+		printf(" %s %s%c%s", argcodes[argcode], "[", argv < 32 ? stack_symbols[argv] : '?', "]");
 		break;
 	}
 }
@@ -215,717 +414,4024 @@ unsigned char read_val(unsigned char* RAM, unsigned char sp, unsigned char *regs
 		return argval;
 		break;
 	}
+	return 0;
 }
 
 
-int main(int argc, char const *argv[])
+//////////////////////////////////////////////////////////////
+///////////////          LOADER           ////////////////////
+//////////////////////////////////////////////////////////////
+
+// marks the operand byte at addr as a stack symbol of function func, see load_code
+#define FIXUP(addr) do { fix_addr[fixups] = (addr); fix_func[fixups++] = label; } while(0)
+// at most 8 functions of 31 instructions with 2 symbol operands each
+#define MAX_FIXUPS (8*31*2)
+
+// loads an image in one sweep. each function is decoded into place (top of RAM
+// downwards, the image lists its instructions last to first), then checked and given its
+// stack symbol names in execution order right away, while it is still in cache
+//
+// symbols are numbered per function first. the final numbering continues one counter
+// across the functions in label order, so the per function bases are only known at the
+// end and the symbol operands are patched then
+//
+// the code ends right below top in RAM and must stay clear of the stack at 0 .. 7, the
+// function entries go to table (0 for none). returns the start of the code segment, or
+// -1 after printing what went wrong
+int load_code(const unsigned char *map, long long size, unsigned char *RAM, int top, int *table)
 {
+	int RAM_ptr = top - 1;
+	int err = 0;
+	int line_number = 0;
+	unsigned char label, count, ins[5];
+
+	// symbol operands to patch and the function they belong to
+	int fix_addr[MAX_FIXUPS];
+	unsigned char fix_func[MAX_FIXUPS];
+	int fixups = 0;
+	int symbol_count[8] = {0};
+	unsigned char called = 0;
+
+	memset(table, 0, 8*sizeof(int));
+	bit_reader br;
+	br_init(&br, map, size);
+
+	// each function is its instruction count, the instructions last to first, then its label
+	while(br_read(&br, 5, &count) && count)
+	{
+		int end = RAM_ptr + 1;
+		line_number = count;
+		for(int i = 0; i < count; ++i)
+		{
+			line_number--;
+			int sz = read_insn(&br, ins, line_number, &err);
+			if(!sz)
+			{
+				return -1;
+			}
+			// the stack starts at 8
+			if(RAM_ptr - sz < 7)
+			{
+				printf("L %d : Overflow has occured. code size exceeds %d bytes\n", line_number, top - 8);
+				return -1;
+			}
+			memcpy(&RAM[RAM_ptr - sz + 1], ins, sz);
+			RAM_ptr -= sz;
+		}
 
-	unsigned char RAM[1<<8];
-	memset(RAM, 0, sizeof(unsigned char)*(1<<8));
+		if(!br_read(&br, 3, &label))
+		{
+			printf("L %d : Unexpected end of image\n", line_number);
+			return -1;
+		}
+		if(table[label])
+		{
+			printf("L %d : Function with label '%d' already encountered. Ensure functions labels are unique\n", line_number, label);
+			return -1;
+		}
+		table[label] = RAM_ptr + 1;
 
+		// symbols must be written before they are read, and every symbol operand gets the
+		// frame slot of its name
+		unsigned char names[1<<5];
+		memset(names, NO_SYMBOL, sizeof(names));
+		unsigned char next = 0;
 
-    ////////////////////////////////////////////////////////////////////////////////////////
-    ////////////////  READING FILE AND LOADING CONTENTS INTO MEMORY  ///////////////////////
-    ////////////////////////////////////////////////////////////////////////////////////////
+		for(int a = RAM_ptr + 1; a < end; a += 1 + 2*layouts[RAM[a]].nargs)
+		{
+			unsigned char *arg = &RAM[a + 1];
+			switch(RAM[a])
+			{
+				case MOV:
+				case REF:
+				// sources first, MOV reads symbols and pointers, REF only takes symbols
+				if(arg[2] == SYMBL || (RAM[a] == MOV && arg[2] == PNTR))
+				{
+					if(names[arg[3]] == NO_SYMBOL)
+					{
+						err = -1;
+						printf(RAM[a] == MOV ? "Attempt to provide uninitialized SYMBL as source in MOV\n"
+							: "Attempt to extract reference to uninitialized SYMBL in REF\n");
+					}
+					else
+					{
+						arg[3] = names[arg[3]];
+						FIXUP(a + 4);
+					}
+				}
+				if(arg[0] == SYMBL || arg[0] == PNTR)
+				{
+					if(names[arg[1]] == NO_SYMBOL)
+					{
+						names[arg[1]] = next++;
+					}
+					arg[1] = names[arg[1]];
+					FIXUP(a + 2);
+				}
+				break;
+
+				case PRINT:
+				if(arg[0] == SYMBL || arg[0] == PNTR)
+				{
+					if(names[arg[1]] == NO_SYMBOL)
+					{
+						err = -1;
+						printf("Attempt to PRINT uninitialized SYMBL\n");
+					}
+					else
+					{
+						arg[1] = names[arg[1]];
+						FIXUP(a + 2);
+					}
+				}
+				break;
+
+				case CAL:
+				// labels above 7 were already reported by read_insn
+				if(arg[1] < 8)
+				{
+					called |= 1 << arg[1];
+				}
+				break;
+			}
+		}
+		symbol_count[label] = next;
+	}
 
+	// bases in label order
+	int base[8];
+	for(int j = 0, total = 0; j<8; ++j)
+	{
+		base[j] = total;
+		total += symbol_count[j];
+	}
+	for(int k = 0; k<fixups; ++k)
+	{
+		RAM[fix_addr[k]] += base[fix_func[k]];
+	}
 
-	if(argc == 1)
+	for(int j = 0; j<8; ++j)
 	{
-		printf("No arguments provided\n");
-		return -1;
+		if((called >> j & 1) && !table[j])
+		{
+			err = -1;
+			printf("Attempt to invoke CAL on a non-existent function label (null function pointer)\n");
+		}
 	}
 
-	const char *address = argv[1];
-	int fd;
-	off_t res;
-	unsigned char *map = map_file(address, &res, &fd);
+	if(!table[0])
+	{
+		err = -1;
+		printf("No entry point defined for the program. One function labelled '0' is necessary\n");
+	}
 
-	switch(res)
+	return err < 0 ? -1 : RAM_ptr + 1;
+}
+
+#undef FIXUP
+#undef MAX_FIXUPS
+
+// the 8 bit machine: code at the top of its 256 bytes, the function table in RAM[0 .. 7]
+int load_image(const unsigned char *map, long long size, unsigned char *RAM)
+{
+	int table[8];
+	int cs = load_code(map, size, RAM, 1<<8, table);
+	for(int j = 0; j<8; ++j)
 	{
-		case -1:
-		printf("Error opening file\n");
-		break;
-		case -2:
-		printf("Error getting file size\n");
-		break;
-		case -3:
-		printf("Empty file\n");
-		break;
-		case -4:
-		printf("Error creating mapping\n");
-		break;
-		default:
-		break;
+		RAM[j] = table[j];
 	}
+	return cs;
+}
 
-	//////////////////////////////////////////////////////////////////////////////////
-    ///////////////          DISPLAYING THE MACHINE CODE          ////////////////////
-    //////////////////////////////////////////////////////////////////////////////////
+// prints every function in the table as assembly, entry to first RET
+void disassemble(const unsigned char *RAM)
+{
+	for(int j = 0; j<8; ++j)
+	{
+		int i = RAM[j];
+		if(!i)
+		{
+			continue;
+		}
+		if(j == 0)
+		{
+			printf("\nENTRY POINT (main)\n");
+		}
+		else
+		{
+			printf("\n");
+		}
+		printf("FUNC %d at %d\n", j, i);
 
-	printf("\nMachine code at %s :\n", address);
-    for(int i = 0; i<res; ++i)
-    {
-    	print_byte(map[i]);
-    }
+		while(i < (1<<8) && RAM[i] <= EQU)
+		{
+			const insn_layout *l = &layouts[RAM[i]];
+			print_instruction(RAM[i]);
+			for(int k = 0; k<l->nargs && i + 2 + 2*k < (1<<8); ++k)
+			{
+				print_args(RAM[i + 1 + 2*k], RAM[i + 2 + 2*k]);
+			}
+			printf("\n");
+			if(RAM[i] == RET)
+			{
+				break;
+			}
+			i += 1 + 2*l->nargs;
+		}
+	}
+}
 
-    printf("\n\n");
-    
 
-    ////////////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////   PARSING THE ASSEMBLY CODE AND LOADING IT TO VIRTUAL RAM   ////////////////////
-    ////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////
+///////////////      OUTPUT CHANNEL       ////////////////////
+//////////////////////////////////////////////////////////////
 
-	printf("Loading parsed instructions into virtual RAM...\n");
-    
-    int func_size = 0;
-    int seg_end = res*8 - 1;
-    int seg_ptr = seg_end;
-    int RAM_ptr = (1<<8) -1;
-    int err;
-	unsigned char curr_op, arg1, arg2, arg1v, arg2v;
+// PRINT through a ring of raw values. the VM only stores the value, a writer thread turns
+// them into "STDOUT : n" lines and hands them to the fd in large writes, so a run does not
+// wait on the terminal or a pipe unless it gets a whole ring ahead of it
 
-	int line_number;
+// values, power of two
+#define OUT_RING		(1<<16)
+// queued values that wake the writer early
+#define OUT_BATCH		(OUT_RING/4)
+// the writer drains whatever is queued at least this often
+#define OUT_LATENCY_MS	20
+// bytes formatted before each write
+#define OUT_CHUNK		(1<<16)
 
-    while(err!=-1)
-    {
-	    func_size = read_bits(map, 5, &seg_ptr, &err);
-		if(func_size <= 0)
+typedef struct vm_output
+{
+	unsigned int ring[OUT_RING];
+	// head only moves in the VM thread and tail only in the writer
+	unsigned int head, tail;
+	// head when the writer was last woken
+	unsigned int woken;
+	int fd;
+	int closing;
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t wake, room;
+} vm_output;
+
+static int out_write(int fd, const char *buf, size_t len)
+{
+	while(len)
+	{
+		ssize_t n = write(fd, buf, len);
+		if(n < 0 && errno == EINTR)
 		{
-			break;
+			continue;
+		}
+		if(n <= 0)
+		{
+			return 0;
 		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+}
 
-	    line_number = func_size;
-	    for(int i = 0; i < func_size; ++i)
-	    {
-	    	if(RAM_ptr <= 8)
-	    	{
-	    		// RAM overflow
-	    		printf("L %d : Overflow has occured. code size exceeds %d bytes\n", line_number, 248);
-	    		err = -1;
-	    		break;
-	    	}
-	    	curr_op = read_bits(map, 3, &seg_ptr, &err);
-	    	line_number--;
-	    	switch(curr_op)
-	    	{
-	    		// MOV
-	    		case 0:
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(!arg1){
-	    			printf("L %d : Illegal arg at position 1 of type : %s given to op of type : MOV (expected address or pointer type)\n", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		switch(arg1)
-	    		{
-	    			case 1:
-	    			arg1v = read_bits(map, 3, &seg_ptr, &err);
-	    			break;
-	    			case 2:
-	    			arg1v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    			case 3:
-	    			arg1v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    		}
-
-	    		arg2 = read_bits(map, 2, &seg_ptr, &err);
-	    		switch(arg2)
-	    		{
-	    			case 0:
-	    			arg2v = read_bits(map, 8, &seg_ptr, &err);
-	    			break;
-	    			case 1:
-	    			arg2v = read_bits(map, 3, &seg_ptr, &err);
-	    			break;
-	    			case 2:
-	    			arg2v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    			case 3:
-	    			arg2v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    		}
-
-	    		RAM[RAM_ptr - 4] = curr_op;
-	    		RAM[RAM_ptr - 3] = arg1;
-	    		RAM[RAM_ptr - 2] = arg1v;
-	    		RAM[RAM_ptr - 1] = arg2;
-	    		RAM[RAM_ptr] = arg2v;
-	    		RAM_ptr-=5;
-
-	    		break;
-
-	    		// CAL
-	    		case 1:
-
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg1 != 0)
-	    		{
-	    			printf("L %d : Illegal arg of type %s given to op of type : CAL (expected value type)\n", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		arg1v = read_bits(map, 8, &seg_ptr, &err);
-
-	    		if(arg1v > 7)
-	    		{
-	    			printf("L %d : Label of function call exceeds maximum value (7)\n", line_number);
-	    			err = -1;
-	    		}
-
-	    		RAM[RAM_ptr-2] = curr_op;
-	    		RAM[RAM_ptr-1] = arg1;
-	    		RAM[RAM_ptr] = arg1v;
-	   			RAM_ptr -= 3;
-
-	    		break;
-
-	    		// RET
-	    		case 2:
-	    		RAM[RAM_ptr] = curr_op;
-	    		RAM_ptr-=1;
-	    		break;
-
-	    		// REF
-	    		case 3:
-
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg1 != 2)
-	    		{
-	    			printf("L %d : Illegal arg at position 1 of type %s given to op of type : REF (expected SYMBL)\n", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		arg1v = read_bits(map, 5, &seg_ptr, &err);
-
-	    		arg2 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg2 == 0)
-	    		{
-	    			printf("L %d : Illegal arg at position 2 of type %s given to op of type : REF (expected address or pointer type)\n", line_number, argcodes[arg2]);
-	    			err = -1;
-	    		}
-	    		switch(arg2)
-	    		{
-	    			case 1:
-	    			arg2v = read_bits(map, 3, &seg_ptr, &err);
-	    			break;
-	    			case 2:
-	    			arg2v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    			case 3:
-	    			arg2v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    		}
-
-	    		RAM[RAM_ptr - 4] = curr_op;
-	    		RAM[RAM_ptr - 3] = arg1;
-	    		RAM[RAM_ptr - 2] = arg1v;
-	    		RAM[RAM_ptr - 1] = arg2;
-	    		RAM[RAM_ptr] = arg2v;
-	    		RAM_ptr-=5;
-
-	    		break;
-
-	    		// ADD
-	    		case 4:
-
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg1 != 1)
-	    		{
-	    			printf("L %d : Illegal arg at position 1 of type %s given to op of type : ADD (expected register address)\n", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		arg1v = read_bits(map, 3, &seg_ptr, &err);
-
-	    		arg2 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg2 != 1)
-	    		{
-	    			printf("L %d : Illegal arg at position 2 of type %s given to op of type : ADD (expected register address)\n", line_number, argcodes[arg2]);
-	    			err = -1;
-	    		}
-	    		arg2v = read_bits(map, 3, &seg_ptr, &err);
-
-	    		RAM[RAM_ptr - 4] = curr_op;
-	    		RAM[RAM_ptr - 3] = arg1;
-	    		RAM[RAM_ptr - 2] = arg1v;
-	    		RAM[RAM_ptr - 1] = arg2;
-	    		RAM[RAM_ptr] = arg2v;
-
-	    		RAM_ptr-=5;
-
-	    		break;
-
-	    		// PRINT
-	    		case 5:
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		switch(arg1)
-	    		{
-	    			case 0:
-	    			arg1v = read_bits(map, 8, &seg_ptr, &err);
-	    			break;
-	    			case 1:
-	    			arg1v = read_bits(map, 3, &seg_ptr, &err);
-	    			break;
-	    			case 2:
-	    			arg1v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    			case 3:
-	    			arg1v = read_bits(map, 5, &seg_ptr, &err);
-	    			break;
-	    		}
-
-	    		RAM[RAM_ptr-2] = curr_op;
-	    		RAM[RAM_ptr-1] = arg1;
-	    		RAM[RAM_ptr] = arg1v;
-	    		RAM_ptr -= 3;
-
-	    		break;
-
-	    		// NOT
-	    		case 6:
-
-	    		arg1 = read_bits(map, 2, &seg_ptr, &err);
-	    		if(arg1 != 1)
-	    		{
-	    			printf("L %d : Illegal arg of type %s given to op of type : NOT (expected register address)", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		arg1v = read_bits(map, 3, &seg_ptr, &err);
-
-	    		RAM[RAM_ptr-2] = curr_op;
-	    		RAM[RAM_ptr-1] = arg1;
-	    		RAM[RAM_ptr] = arg1v;
-
-	    		break;
-
-	    		// EQU
-	    		case 7:
-
-	    		arg1 = read_bits(map, 3, &seg_ptr, &err);
-	    		if(arg1 != 1)
-	    		{
-	    			printf("L %d : Illegal arg of type %s given to op of type : EQU (expected register address)", line_number, argcodes[arg1]);
-	    			err = -1;
-	    		}
-	    		arg1v = read_bits(map, 3, &seg_ptr, &err);
-
-	    		RAM[RAM_ptr-2] = curr_op;
-	    		RAM[RAM_ptr-1] = arg1;
-	    		RAM[RAM_ptr] = arg1v;
-	    		RAM_ptr-=3;
-
-	    		break;
-
-	    		default:
-	    		break;
-	    	}
-	    }
-    	arg1 = read_bits(map, 3, &seg_ptr, &err);
-    	if(!RAM[arg1])
+static void *out_writer(void *arg)
+{
+	vm_output *o = arg;
+	char *buf = malloc(OUT_CHUNK);
+	// signals, SIGPROF from the sampling profiler included, go to the VM thread
+	sigset_t all;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	for(;;)
+	{
+		pthread_mutex_lock(&o->lock);
+		while(__atomic_load_n(&o->head, __ATOMIC_ACQUIRE) == o->tail && !o->closing)
 		{
-			RAM[arg1] = RAM_ptr + 1;
+			struct timespec until;
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_nsec += OUT_LATENCY_MS*1000000L;
+			if(until.tv_nsec >= 1000000000L)
+			{
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000L;
+			}
+			pthread_cond_timedwait(&o->wake, &o->lock, &until);
 		}
-		else 
+		int closing = o->closing;
+		pthread_mutex_unlock(&o->lock);
+
+		unsigned int head = __atomic_load_n(&o->head, __ATOMIC_ACQUIRE), tail = o->tail;
+		while(tail != head)
+		{
+			size_t len = 0;
+			for(; tail != head && len + 32 <= OUT_CHUNK; ++tail)
+			{
+				char digits[10];
+				int n = 0;
+				unsigned int v = o->ring[tail & (OUT_RING - 1)];
+				do
+				{
+					digits[n++] = '0' + v % 10;
+					v /= 10;
+				}
+				while(v);
+				memcpy(buf + len, "STDOUT : ", 9);
+				len += 9;
+				while(n)
+				{
+					buf[len++] = digits[--n];
+				}
+				buf[len++] = '\n';
+			}
+			// a closed pipe drops the rest, the run itself goes on
+			out_write(o->fd, buf, len);
+
+			pthread_mutex_lock(&o->lock);
+			__atomic_store_n(&o->tail, tail, __ATOMIC_RELEASE);
+			pthread_cond_signal(&o->room);
+			pthread_mutex_unlock(&o->lock);
+		}
+		if(closing)
 		{
-			err = -1;
-			printf("L %d : Function with label '%d' already encountered. Ensure functions labels are unique\n", line_number, arg1);
 			break;
 		}
-    	arg1 = 0;
 	}
+	free(buf);
+	return NULL;
+}
 
-	if(!RAM[0])
+// returns 0, or -1 when the writer thread could not be started
+int out_open(vm_output *o, int fd)
+{
+	o->head = o->tail = o->woken = 0;
+	o->fd = fd;
+	o->closing = 0;
+	pthread_mutex_init(&o->lock, NULL);
+	pthread_cond_init(&o->wake, NULL);
+	pthread_cond_init(&o->room, NULL);
+	if(pthread_create(&o->writer, NULL, out_writer, o))
 	{
-		err = -1;
-		printf("No entry point defined for the program. One function labelled '0' is necessary\n");
+		pthread_cond_destroy(&o->room);
+		pthread_cond_destroy(&o->wake);
+		pthread_mutex_destroy(&o->lock);
+		return -1;
 	}
+	return 0;
+}
 
-	unmap_file(map, fd, res);
-	RAM_ptr++;
+static void out_wake(vm_output *o)
+{
+	o->woken = o->head;
+	pthread_mutex_lock(&o->lock);
+	pthread_cond_signal(&o->wake);
+	pthread_mutex_unlock(&o->lock);
+}
 
-    if(err < 0)
-    {
-    	printf("Fatal errors occured during parse. Check log messages for more info.\n");
-    	return -1;
-    }
+static inline void out_put(vm_output *o, unsigned int value)
+{
+	unsigned int head = o->head;
+	if(head - __atomic_load_n(&o->tail, __ATOMIC_ACQUIRE) == OUT_RING)
+	{
+		out_wake(o);
+		pthread_mutex_lock(&o->lock);
+		while(head - o->tail == OUT_RING)
+		{
+			pthread_cond_wait(&o->room, &o->lock);
+		}
+		pthread_mutex_unlock(&o->lock);
+	}
+	o->ring[head & (OUT_RING - 1)] = value;
+	__atomic_store_n(&o->head, head + 1, __ATOMIC_RELEASE);
+	if(head + 1 - o->woken >= OUT_BATCH)
+	{
+		out_wake(o);
+	}
+}
 
+// vm_context print callback, user is the vm_output
+void out_print(void *user, unsigned char value)
+{
+	out_put(user, value);
+}
 
-    //////////////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////       LOOKING FOR UNITIALIZED VARIABLES, FUNCTIONS      //////////////////////////
-    ///////////////       AND NAMING STACK SYMBOLS PROPERLY                 //////////////////////////
-    //////////////////////////////////////////////////////////////////////////////////////////////////
+// writes out everything queued and stops the writer
+void out_close(vm_output *o)
+{
+	pthread_mutex_lock(&o->lock);
+	o->closing = 1;
+	pthread_cond_signal(&o->wake);
+	pthread_mutex_unlock(&o->lock);
+	pthread_join(o->writer, NULL);
+	pthread_cond_destroy(&o->room);
+	pthread_cond_destroy(&o->wake);
+	pthread_mutex_destroy(&o->lock);
+}
 
-   	printf("Performing semantic checks...\n");
 
-    unsigned char symbol_counter = 0;
+//////////////////////////////////////////////////////////////
+///////////////   SINGLE STEP INTERPRETER   //////////////////
+//////////////////////////////////////////////////////////////
 
-    // CODE SEGMENT , STACK SEGMENT, ADDRESS SEGMENT
-    unsigned char CS = RAM_ptr, SS = 8, RS = 0;
+static inline void vm_print(vm_context *vm, unsigned char value)
+{
+	if(vm->print)
+	{
+		vm->print(vm->user, value);
+	}
+	else
+	{
+		printf("STDOUT : %d\n", value);
+	}
+}
 
-    err = 0;
-    curr_op = 0;
-    arg1 = 0;
-    arg2 = 0;
-    arg1v = 0;
-    arg2v = 0;
+// executes the instruction at reg_bank[PC], returns 1 when main returns and 0 otherwise
+// this is the reference semantics, the pre-decoded loop below falls back to it for
+// anything it has no handler for
+int vm_step(vm_context *vm)
+{
+	unsigned char *RAM = vm->RAM, *reg_bank = vm->reg_bank;
+	unsigned char arg1, arg1v, arg2, arg2v;
 
-    unsigned char stack_symbol_buffer[1<<5];
+	switch(RAM[reg_bank[PC]])
+	{
+		case MOV:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		arg2 = RAM[reg_bank[PC]+3];
+		arg2v = RAM[reg_bank[PC]+4];
+		write_val(RAM, reg_bank[SP], reg_bank, arg1, arg1v, read_val(RAM, reg_bank[SP], reg_bank, arg2, arg2v));
+		reg_bank[PC] += 5;
+		break;
 
-    for(int i = 0; i<8; ++i)
-    {
-    	if(!RAM[i])
-    	{
-    		continue;
-    	}
-    	RAM_ptr = RAM[i];
+		case CAL:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		reg_bank[PC] += 3;
+		RAM[reg_bank[SP] + reg_bank[SZ]] = reg_bank[SZ];
+		RAM[reg_bank[SP] + reg_bank[SZ] + 1] = reg_bank[PC];
+		reg_bank[PC] = RAM[arg1v];
+		reg_bank[SP] += reg_bank[SZ] + 2;
+		break;
 
-    	// resetting stack symbol buffer
-    	for(int i = 0; i<32; ++i)
-    	{
-    		stack_symbol_buffer[i] = NO_SYMBOL;
-    	}
+		case RET:
+		if(reg_bank[SP] == 8)
+		{
+			return 1;
+		}
+		reg_bank[SZ] = RAM[reg_bank[SP] - 2];
+		reg_bank[PC] = RAM[reg_bank[SP] - 1];
+		reg_bank[SP] = reg_bank[SP] - 2 - RAM[reg_bank[SP] - 2];
+		break;
 
-    	while(1)
-    	{
-	    	switch(RAM[RAM_ptr])
-	    	{
-	    		// MOV
-	    		case 0:
-
-	    		curr_op = RAM[RAM_ptr];
-	    		arg1 = RAM[RAM_ptr+1];
-	    		arg1v = RAM[RAM_ptr+2];
-	    		arg2 = RAM[RAM_ptr+3];
-	    		arg2v = RAM[RAM_ptr+4];
-
-	    		// CHECKS
-	    		// 1. Source should be intialized if it is a symbol
-	    		if((arg2 == SYMBL || arg2 == PNTR) && stack_symbol_buffer[arg2v] == NO_SYMBOL)
-	    		{
-	    			err = -1;
-	    			printf("Attempt to provide uninitialized SYMBL as source in MOV\n");
-	    		}
-	    		else if((arg2 == SYMBL || arg2 == PNTR) && stack_symbol_buffer[arg2v] != NO_SYMBOL)
-	    		{
-	    			RAM[RAM_ptr+4] = stack_symbol_buffer[arg2v];
-	    		}
-
-	    		if((arg1 == SYMBL || arg1 == PNTR) && stack_symbol_buffer[arg1v] == NO_SYMBOL)
-	    		{
-	    			stack_symbol_buffer[arg1v] = symbol_counter;
-	    			RAM[RAM_ptr+2] = symbol_counter;
-	    			symbol_counter++;
-	    		}
-	    		else if((arg1 == SYMBL || arg1 == PNTR) && stack_symbol_buffer[arg1v] != NO_SYMBOL)
-	    		{
-	    			RAM[RAM_ptr+2] = stack_symbol_buffer[arg1v];
-	    		}
-
-	    		RAM_ptr+=5;
-	    		break;
-
-	    		// CAL
-	    		case 1:
-
-	    		curr_op = RAM[RAM_ptr];
-	    		arg1 = RAM[RAM_ptr+1];
-	    		arg1v = RAM[RAM_ptr+2];
-
-	    		// CHECKS
-	    		// 1. Function label should exist in memory
-	    		if(!RAM[arg1v])
-	    		{
-	    			err = -1;
-	    			printf("Attempt to invoke CAL on a non-existent function label (null function pointer)\n");
-	    		}
-
-	    		RAM_ptr+=3;
-	    		break;
-
-	    		// RET
-	    		case 2:
-	    		// Nothing to check
-	    		break;
-
-	    		// REF
-	    		case 3:
-
-	    		curr_op = RAM[RAM_ptr];
-	    		arg1 = RAM[RAM_ptr+1];
-	    		arg1v = RAM[RAM_ptr+2];
-	    		arg2 = RAM[RAM_ptr+3];
-	    		arg2v = RAM[RAM_ptr+4];
-
-	    		// CHECKS
-	    		// 1. Source stack symbol should be initialized
-	    		if(arg2 == SYMBL && stack_symbol_buffer[arg2v] == NO_SYMBOL)
-	    		{
-	    			err = -1;
-	    			printf("Attempt to extract reference to uninitialized SYMBL in REF\n");
-	    		}
-	    		else if(arg2 == SYMBL && stack_symbol_buffer[arg2v] != NO_SYMBOL)
-	    		{
-	    			RAM[RAM_ptr+4] = stack_symbol_buffer[arg2v];
-	    		}
-
-	    		if((arg1 == SYMBL || arg1 == PNTR) && stack_symbol_buffer[arg1v] == NO_SYMBOL)
-	    		{
-	    			stack_symbol_buffer[arg1v] = symbol_counter;
-	    			RAM[RAM_ptr+2] = symbol_counter;
-	    			symbol_counter++;
-	    		}
-	    		else if((arg1 == SYMBL || arg1 == PNTR) && stack_symbol_buffer[arg1v] != NO_SYMBOL)
-	    		{
-	    			RAM[RAM_ptr+2] = stack_symbol_buffer[arg1v];
-	    		}
-
-	    		RAM_ptr += 5;
-	    		break;
-
-	    		// ADD
-	    		case 4:
-	    		// Nothing to check
-	    		RAM_ptr += 5;
-	    		break;
-
-	    		// PRINT
-	    		case 5:
-	    		// Nothing to check
-	    		RAM_ptr += 3;
-	    		break;
-
-	    		// NOT
-	    		case 6:
-	    		// Nothing to check
-	    		RAM_ptr += 3;
-	    		break;
-
-	    		// EQU
-	    		case 7:
-	    		// Nothing to check
-	    		RAM_ptr += 3;
-	    		break;
-	    	}
-	    	// RET
-    		if(RAM[RAM_ptr] == 2)
-    		{
-    			break;
-    		}
-	    }
-    }
+		case REF:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		arg2 = RAM[reg_bank[PC]+3];
+		arg2v = RAM[reg_bank[PC]+4];
+		RAM[reg_bank[SP] + arg1v] = reg_bank[SP] + arg2v;
+		reg_bank[PC] += 5;
+		break;
 
-    //////////////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////////    DISPLAYING THE MACHINE CODE AS ASSEMBLY CODE    ///////////////////////////
-    //////////////////////////////////////////////////////////////////////////////////////////////////
+		case ADD:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		arg2 = RAM[reg_bank[PC]+3];
+		arg2v = RAM[reg_bank[PC]+4];
+		reg_bank[arg1v] += reg_bank[arg2v];
+		reg_bank[PC] += 5;
+		break;
 
-    printf("Disassembling machine code...\nDisassembled code:\n");
-    int i = 0;
-    for(int j = 0; j<8; ++j)
-    {
-    	i = RAM[j];
-    	if(!i)
-    	{
-    		continue;
-    	}
-    	if(j == 0)
-    	{
-    		printf("\nENTRY POINT (main)\n");
-    	}
-    	else 
-    	{
-    		printf("\n");
-    	}
-    	printf("FUNC %d at %d\n", j, i);
-
-	    while(1){
-	    	print_instruction(RAM[i]);
-	    	if(RAM[i] == 2)
-	    	{
-	    		printf("\n");
-	    		break;
-	    	}
-	    	switch(RAM[i]){
-	    		// MOV
-	    		case 0:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	print_args(RAM[i+3], RAM[i+4]);
-		    	printf("\n");    		
-		    	i += 5;
-	    		break; 
-
-	    		// CAL
-	    		case 1:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	printf("\n");
-		    	i += 3;
-	    		break;
-
-	    		// RET
-	    		case 2:
-	    		break;
-
-	    		// REF
-	    		case 3:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	print_args(RAM[i+3], RAM[i+4]);
-		    	printf("\n");
-		    	i += 5;
-	    		break;
-
-	    		// ADD
-	    		case 4:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	print_args(RAM[i+3], RAM[i+4]);
-		    	printf("\n");    		
-		    	i += 5;
-	    		break; 
-
-	    		// PRINT
-	    		case 5:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	printf("\n");
-		    	i += 3;
-	    		break;
-
-	    		// NOT
-	    		case 6:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	printf("\n");
-		    	i += 3;
-	    		break;
-
-	    		// NOT
-	    		case 7:
-		    	print_args(RAM[i+1], RAM[i+2]);
-		    	printf("\n");
-		    	i += 3;
-	    		break;
-	    	}
-	    }
-	}
+		case PRINT:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		vm_print(vm, read_val(RAM, reg_bank[SP], reg_bank, arg1, arg1v));
+		reg_bank[PC] += 3;
+		break;
 
+		case NOT:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		reg_bank[arg1v] = ~reg_bank[arg1v];
+		reg_bank[PC] += 3;
+		break;
 
-    /////////////////////////////////////////////////////////////////////////////////////////////
-    /////////////// OPTIMIZING THE MACHINE CODE TO USE LESS STACK SPACE /////////////////////////
-    /////////////////////////////////////////////////////////////////////////////////////////////
+		case EQU:
+		arg1 = RAM[reg_bank[PC]+1];
+		arg1v = RAM[reg_bank[PC]+2];
+		reg_bank[arg1v] = !reg_bank[arg1v];
+		reg_bank[PC] += 3;
+		break;
+	}
+	return 0;
+}
 
 
-    /*
+//////////////////////////////////////////////////////////////
+///////////////         PROFILER          ////////////////////
+//////////////////////////////////////////////////////////////
 
-		COMPLICATED AND PROBABLY UNNECESSARY. KEEP IT AS A PROJECT WITH A 
-		MORE ADVANCED INSTRUCTION SET FOR LATER MAYBE?
+// runs on the tracing hook, so with no profile vm_run has no extra work at all.
+// PROF_COUNT looks at every instruction: counts per PC and per opcode, and per function
+// calls and instructions, self (in the function itself) and total (with its callees).
+// functions are told apart by CAL label and followed on a shadow stack, CAL pushes and
+// RET pops. PROF_SAMPLE only looks when a SIGPROF timer went off and walks the frames
+// the machine saved on its stack back to main, so between samples the hook costs one
+// extra jump. every counter then holds samples instead of instructions, and calls are
+// unknown
+//
+// both fold what they see into a call tree, written at exit as "main;f3;f5 count"
+// lines, the folded stack format flamegraph.pl and speedscope read
+
+#define PROF_OFF		0
+#define PROF_COUNT		1
+#define PROF_SAMPLE		2
+
+// deeper calls are counted in their caller
+#define PROF_DEPTH		128
+// call tree nodes, new paths past it are counted in their parent
+#define PROF_NODES		4096
+// sampling period in microseconds of CPU time
+#define PROF_PERIOD		1000
+
+typedef struct
+{
+	// parent, first child, next sibling
+	short parent, first, next;
+	// CAL label the node was entered through
+	unsigned char label;
+	unsigned long long self;
+} prof_node;
+
+typedef struct vm_profile
+{
+	int mode;
+	unsigned long long pc[1<<8];
+	// MOV .. EQU, then anything else
+	unsigned long long op[9];
+	// by CAL label
+	unsigned long long calls[1<<8], self[1<<8], total[1<<8];
+	unsigned long long samples;
+
+	// shadow stack for PROF_COUNT: call tree node, label and instruction count at entry,
+	// and how many frames of each label are open so recursion adds to total only once
+	int depth, lost;
+	short node[PROF_DEPTH];
+	unsigned char label[PROF_DEPTH];
+	unsigned long long entered[PROF_DEPTH];
+	unsigned char open[1<<8];
+
+	prof_node tree[PROF_NODES];
+	int nodes;
+
+	// set from the SIGPROF handler
+	volatile sig_atomic_t pending;
+} vm_profile;
+
+// main is the root of the call tree and the bottom of the shadow stack
+void prof_init(vm_profile *p, int mode)
+{
+	memset(p, 0, sizeof(*p));
+	p->mode = mode;
+	p->nodes = 1;
+	p->tree[0].first = p->tree[0].next = -1;
+	p->depth = 1;
+	p->open[0] = 1;
+	p->calls[0] = 1;
+}
 
-    */
+// the child of parent entered through label, made on first use
+static int prof_child(vm_profile *p, int parent, unsigned char label)
+{
+	int n = p->tree[parent].first;
+	while(n >= 0 && p->tree[n].label != label)
+	{
+		n = p->tree[n].next;
+	}
+	if(n >= 0)
+	{
+		return n;
+	}
+	if(p->nodes == PROF_NODES)
+	{
+		return parent;
+	}
+	n = p->nodes++;
+	p->tree[n] = (prof_node){parent, -1, p->tree[parent].first, label, 0};
+	p->tree[parent].first = n;
+	return n;
+}
 
+// label of the function whose code holds addr: the closest entry at or below it.
+// 0 below the code segment
+static unsigned char prof_func_of(const unsigned char *RAM, unsigned char addr)
+{
+	int best = 0, at = -1;
+	for(int j = 0; j<8; ++j)
+	{
+		if(RAM[j] && RAM[j] <= addr && RAM[j] > at)
+		{
+			best = j;
+			at = RAM[j];
+		}
+	}
+	return best;
+}
 
+// one sample: the function at pc, then the function of every saved return address
+static void prof_sample(vm_profile *p, const unsigned char *RAM, const unsigned char *regs, unsigned char pc)
+{
+	unsigned char path[PROF_DEPTH], seen[1<<8] = {0};
+	int n = 0;
+	path[n++] = prof_func_of(RAM, pc);
+	for(int sp = regs[SP]; sp > 8 && sp >= 2 && n < PROF_DEPTH; )
+	{
+		path[n++] = prof_func_of(RAM, RAM[sp - 1]);
+		int next = sp - 2 - RAM[sp - 2];
+		if(next >= sp)
+		{
+			break;
+		}
+		sp = next;
+	}
 
-    /////////////////////////////////////////////////////////////////////////////////////////////
-    ///////////////    RUNNING THE MACHINE CODE ON A VIRTUAL MACHINE    /////////////////////////
+	// the outermost frame is main, the root
+	int node = 0;
+	for(int i = n - 2; i >= 0; --i)
+	{
+		node = prof_child(p, node, path[i]);
+	}
+	p->tree[node].self++;
+	p->self[path[0]]++;
+	for(int i = 0; i<n; ++i)
+	{
+		if(!seen[path[i]]++)
+		{
+			p->total[path[i]]++;
+		}
+	}
+	p->pc[pc]++;
+	p->op[RAM[pc] > EQU ? 8 : RAM[pc]]++;
+	p->samples++;
+}
+
+// called by the hook before the instruction at pc runs, count includes it
+static void prof_insn(vm_profile *p, const unsigned char *RAM, const unsigned char *regs, unsigned char pc, unsigned long long count)
+{
+	if(p->mode == PROF_SAMPLE)
+	{
+		if(p->pending)
+		{
+			p->pending = 0;
+			prof_sample(p, RAM, regs, pc);
+		}
+		return;
+	}
+
+	unsigned char op = RAM[pc];
+	int top = p->depth - 1;
+	p->pc[pc]++;
+	p->op[op > EQU ? 8 : op]++;
+	p->self[p->label[top]]++;
+	p->tree[p->node[top]].self++;
+
+	if(op == CAL)
+	{
+		unsigned char label = RAM[(unsigned char)(pc + 2)];
+		p->calls[label]++;
+		if(p->depth == PROF_DEPTH)
+		{
+			p->lost++;
+			return;
+		}
+		p->node[p->depth] = prof_child(p, p->node[top], label);
+		p->label[p->depth] = label;
+		p->entered[p->depth] = count;
+		p->open[label]++;
+		p->depth++;
+	}
+	else if(op == RET)
+	{
+		if(p->lost)
+		{
+			p->lost--;
+		}
+		// main stays, it is closed by prof_finish
+		else if(p->depth > 1)
+		{
+			p->depth--;
+			unsigned char label = p->label[p->depth];
+			if(!--p->open[label])
+			{
+				p->total[label] += count - p->entered[p->depth];
+			}
+		}
+	}
+}
+
+// closes whatever is still open when the run ends, count being the last instruction
+void prof_finish(vm_profile *p, unsigned long long count)
+{
+	if(p->mode != PROF_COUNT)
+	{
+		return;
+	}
+	while(p->depth > 0)
+	{
+		p->depth--;
+		unsigned char label = p->label[p->depth];
+		if(!--p->open[label])
+		{
+			p->total[label] += count - p->entered[p->depth];
+		}
+	}
+}
+
+static void prof_name(FILE *f, unsigned char label)
+{
+	if(label)
+	{
+		fprintf(f, "f%d", label);
+	}
+	else
+	{
+		fprintf(f, "main");
+	}
+}
+
+// folded stacks, one line per call tree node that ran anything itself
+static void prof_fold(FILE *f, const vm_profile *p, int n)
+{
+	if(p->tree[n].self)
+	{
+		int path[PROF_DEPTH], len = 0;
+		for(int k = n; k > 0 && len < PROF_DEPTH; k = p->tree[k].parent)
+		{
+			path[len++] = k;
+		}
+		prof_name(f, 0);
+		while(len--)
+		{
+			fprintf(f, ";");
+			prof_name(f, p->tree[path[len]].label);
+		}
+		fprintf(f, " %llu\n", p->tree[n].self);
+	}
+	for(int c = p->tree[n].first; c >= 0; c = p->tree[c].next)
+	{
+		prof_fold(f, p, c);
+	}
+}
+
+// the tables on stdout and the folded stacks to path. returns 0 if path could not be written
+int prof_report(const vm_profile *p, const unsigned char *RAM, const char *path)
+{
+	const char *unit = p->mode == PROF_SAMPLE ? "samples" : "instructions";
+	unsigned long long all = 0;
+	for(int k = 0; k<9; ++k)
+	{
+		all += p->op[k];
+	}
+	double pct = all ? 100.0/all : 0;
+
+	printf("\nProfile (%s, %llu in all)\n", unit, all);
+	printf("%-6s %12s %12s %7s %12s %7s\n", "func", "calls", "self", "%", "total", "%");
+	for(int l = 0; l<(1<<8); ++l)
+	{
+		if(!p->calls[l] && !p->self[l] && !p->total[l])
+		{
+			continue;
+		}
+		char name[8];
+		snprintf(name, sizeof(name), l ? "f%d" : "main", l);
+		if(p->mode == PROF_SAMPLE)
+		{
+			printf("%-6s %12s %12llu %6.1f%% %12llu %6.1f%%\n", name, "-", p->self[l], p->self[l]*pct, p->total[l], p->total[l]*pct);
+		}
+		else
+		{
+			printf("%-6s %12llu %12llu %6.1f%% %12llu %6.1f%%\n", name, p->calls[l], p->self[l], p->self[l]*pct, p->total[l], p->total[l]*pct);
+		}
+	}
+
+	printf("\nopcodes :");
+	for(int k = 0; k<9; ++k)
+	{
+		if(p->op[k])
+		{
+			printf(" %.*s %llu (%.1f%%)", k < 8 ? (int)strcspn(opcodes[k], " ") : 3, k < 8 ? opcodes[k] : "bad", p->op[k], p->op[k]*pct);
+		}
+	}
+	printf("\n");
+
+	// hottest addresses, disassembled from the RAM as it was at the end of the run
+	printf("\nhottest instructions :\n");
+	unsigned char done[1<<8] = {0};
+	for(int rank = 0; rank<10; ++rank)
+	{
+		int best = -1;
+		for(int a = 0; a<(1<<8); ++a)
+		{
+			if(!done[a] && p->pc[a] && (best < 0 || p->pc[a] > p->pc[best]))
+			{
+				best = a;
+			}
+		}
+		if(best < 0)
+		{
+			break;
+		}
+		done[best] = 1;
+		printf("%4d %12llu %6.1f%%  ", best, p->pc[best], p->pc[best]*pct);
+		if(RAM[best] <= EQU)
+		{
+			const insn_layout *l = &layouts[RAM[best]];
+			printf("%s", opcodes[RAM[best]]);
+			for(int k = 0; k<l->nargs && best + 2 + 2*k < (1<<8); ++k)
+			{
+				print_args(RAM[best + 1 + 2*k], RAM[best + 2 + 2*k]);
+			}
+		}
+		printf("\n");
+	}
+
+	FILE *f = fopen(path, "w");
+	if(!f)
+	{
+		return 0;
+	}
+	prof_fold(f, p, 0);
+	fclose(f);
+	return 1;
+}
+
+// the SIGPROF handler can only reach the profile through a global, so one sampled run
+// at a time
+static vm_profile *prof_sampled;
+
+static void prof_tick(int sig)
+{
+	(void)sig;
+	if(prof_sampled)
+	{
+		prof_sampled->pending = 1;
+	}
+}
+
+// starts or, with p NULL, stops the SIGPROF timer
+void prof_timer(vm_profile *p)
+{
+	struct itimerval t = {{0, p ? PROF_PERIOD : 0}, {0, p ? PROF_PERIOD : 0}};
+	prof_sampled = p;
+	if(p)
+	{
+		signal(SIGPROF, prof_tick);
+	}
+	setitimer(ITIMER_PROF, &t, NULL);
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////   PRE-DECODED DISPATCH   /////////////////////
+//////////////////////////////////////////////////////////////
+
+// every instruction in the code segment gets one decoded entry, indexed by its address:
+// the handler that runs it (a label inside vm_run, labels as values being a gcc /
+// clang extension, so dispatch is a single indirect jump) and its operands already pulled out of RAM. reading the PC register
+// always yields the address of the instruction itself, so it is folded into a constant
+//
+// the functions in the table are translated up front, anything else is decoded the first
+// time PC lands on it. a store into the code segment drops the entries it overlaps and
+// they are decoded again when reached, so self modifying programs still behave
+
+// handler ids. MOV is specialized per destination / source kind (H_MOV_<dst><src>),
+// writes to the PC register other than MOV and ADD, and operand kinds the loader
+// never produces, go through vm_step. the last two are superinstructions, pairs that
+// fuse_insn runs as one dispatch
+enum
+{
+	H_DECODE, H_SLOW, H_BAD, H_NOP,
+	H_MOV_RC, H_MOV_RR, H_MOV_RS, H_MOV_RP,
+	H_MOV_SC, H_MOV_SR, H_MOV_SS, H_MOV_SP,
+	H_MOV_PC, H_MOV_PR, H_MOV_PS, H_MOV_PP,
+	H_JMP, H_CAL, H_RET, H_REF, H_ADD, H_ADD_PC,
+	H_PRINT_C, H_PRINT_R, H_PRINT_S, H_PRINT_P,
+	H_NOT, H_EQU,
+	H_MOV_ADD, H_NOT_EQU,
+	H_COUNT
+};
+
+typedef struct
+{
+	const void *handler;
+	// first and second operand values, src is the source kind for H_JMP and the ADD
+	// destination for H_MOV_ADD
+	unsigned char a, b, src;
+	// address of the following instruction
+	unsigned char next;
+	// handler id, needed when the entry points at the tracing hook instead
+	unsigned char h;
+} decoded_insn;
+
+// picks the handler for the instruction at addr and fills in its operands
+// *len gets the encoded length
+int decode_insn(const unsigned char *RAM, unsigned char addr, unsigned char *a, unsigned char *b, unsigned char *src, int *len)
+{
+	unsigned char k1 = RAM[(addr+1) & 0xFF], v1 = RAM[(addr+2) & 0xFF];
+	unsigned char k2 = RAM[(addr+3) & 0xFF], v2 = RAM[(addr+4) & 0xFF];
+
+	*a = v1;
+	*b = v2;
+	*src = k2;
+	switch(RAM[addr])
+	{
+		case MOV:
+		*len = 5;
+		if(k2 == RGSTR && v2 == PC)
+		{
+			*src = k2 = CNST;
+			*b = addr;
+		}
+		if(k1 > PNTR || k2 > PNTR || (k1 == RGSTR && v1 > PC) || (k2 == RGSTR && v2 > PC))
+		{
+			return H_SLOW;
+		}
+		if(k1 == CNST)
+		{
+			return H_NOP;
+		}
+		if(k1 == RGSTR && v1 == PC)
+		{
+			return H_JMP;
+		}
+		return H_MOV_RC + (k1 - RGSTR)*4 + k2;
+
+		case CAL:
+		*len = 3;
+		*a = v1;
+		return H_CAL;
+
+		case RET:
+		*len = 1;
+		return H_RET;
+
+		case REF:
+		*len = 5;
+		return H_REF;
+
+		case ADD:
+		*len = 5;
+		if(v1 > PC || v2 > PC || v2 == PC)
+		{
+			return H_SLOW;
+		}
+		return v1 == PC ? H_ADD_PC : H_ADD;
+
+		case PRINT:
+		*len = 3;
+		if(k1 == RGSTR && v1 == PC)
+		{
+			k1 = CNST;
+			*a = addr;
+		}
+		if(k1 > PNTR || (k1 == RGSTR && v1 > PC))
+		{
+			return H_SLOW;
+		}
+		return H_PRINT_C + k1;
+
+		case NOT:
+		case EQU:
+		*len = 3;
+		if(v1 >= PC)
+		{
+			return H_SLOW;
+		}
+		return RAM[addr] == NOT ? H_NOT : H_EQU;
+	}
+	*len = 1;
+	return H_BAD;
+}
+
+// MOV of a constant into a register followed by an ADD of that register, and NOT followed
+// by EQU of the same register, are common enough to run as one handler. given the entry
+// decoded at addr as h, returns the fused id with *len covering both instructions, or h
+// when the next instruction does not pair. both only touch registers below SP, so neither
+// needs the overflow check
+int fuse_insn(const unsigned char *RAM, int addr, int h, decoded_insn *d, int *len)
+{
+	unsigned char a, b, src;
+	int len2, next = addr + *len;
+
+	if((h != H_MOV_RC && h != H_NOT) || d->a >= SP || next >= (1<<8))
+	{
+		return h;
+	}
+	int h2 = decode_insn(RAM, next, &a, &b, &src, &len2);
+	if(next + len2 > (1<<8))
+	{
+		return h;
+	}
+	if(h == H_MOV_RC && h2 == H_ADD && b == d->a && a < SP)
+	{
+		d->src = a;
+		*len += len2;
+		return H_MOV_ADD;
+	}
+	if(h == H_NOT && h2 == H_EQU && a == d->a)
+	{
+		*len += len2;
+		return H_NOT_EQU;
+	}
+	return h;
+}
+
+// first address from addr on that does not hold a NOP, so an entry can link past the
+// dead stores the optimizer leaves behind (MOVs to a constant) and they cost nothing
+int skip_nops(const unsigned char *RAM, int addr)
+{
+	unsigned char a, b, src;
+	int len;
+	while(addr + 5 <= (1<<8) && decode_insn(RAM, addr, &a, &b, &src, &len) == H_NOP)
+	{
+		addr += 5;
+	}
+	return addr;
+}
+
+//////////////////////////////////////////////////////////////
+///////////////   STACK DEPTH ANALYSIS    ////////////////////
+//////////////////////////////////////////////////////////////
+
+// bounds the stack of a run from vm_reset by walking the call graph from main. CAL never
+// sets SZ, so with nothing else writing SP or SZ every frame is the 2 saved bytes and a
+// function entered at call depth d runs at SP = 8 + 2d, writing at most up to SP plus its
+// highest symbol. a function is all the code from its entry up to the next entry of the
+// table, and control has to stay inside it: every jump, constant or computed (MOV or ADD
+// into PC), must be shown to land on one of its instructions, so the highest store
+// anywhere in the range bounds every path through it. a pointer store is bounded when the
+// pointer was set by a REF earlier in the same straight run of code, with no CAL, jump
+// target or other write to it in between. any other pointer store can reach saved frames
+// and the table, so it, writes to SP or SZ, what is left to vm_step and recursion are
+// never bounded
+
+// start of the function after the one at entry, the top of RAM for the last one
+static int func_end(const unsigned char *RAM, unsigned char CS, unsigned char entry)
+{
+	int end = 1<<8;
+	for(int j = 0; j<8; ++j)
+	{
+		if(RAM[j] >= CS && RAM[j] > entry && RAM[j] < end)
+		{
+			end = RAM[j];
+		}
+	}
+	return end;
+}
+
+// r0 .. r4 along one path through the straight run before a computed jump
+#define JUMP_PATHS	16
+
+typedef struct
+{
+	unsigned char v[SP];
+	// bit r set when v[r] is known
+	unsigned char known;
+} jump_path;
+
+// marks in target[] every instruction of the function at entry a jump can land on, with
+// boundary[] holding its instruction starts. a computed jump is followed through r0 .. r4
+// over the straight run before it: constants, copies, ADD, NOT, and EQU, which splits an
+// unknown value into a 0 and a 1 path, so a skip of 5 * (r != 0) added to PC comes out as
+// its two targets. a target starts a run with nothing known, so the walk repeats until no
+// new target turns up. returns -1 when a jump can leave the function, land inside an
+// instruction or depends on a value that is not known
+static int jump_targets(const unsigned char *RAM, unsigned char entry, int end, const char *boundary, char *target)
+{
+	unsigned char a, b, src;
+	jump_path p[JUMP_PATHS];
+	int len, n = 1;
+
+	memset(p, 0, sizeof(p));
+	memset(target, 0, 1<<8);
+	for(int changed = 1; changed; )
+	{
+		changed = 0;
+		for(int i = entry, falls = 0; i < end; i += len)
+		{
+			int h = decode_insn(RAM, i, &a, &b, &src, &len);
+			// control can arrive here from elsewhere with any registers, and the callee of a
+			// CAL or vm_step may leave any
+			if(!falls || target[i] || h == H_SLOW)
+			{
+				n = 1;
+				p[0].known = 0;
+			}
+			falls = h != H_RET && h != H_JMP && h != H_ADD_PC && h != H_BAD;
+			if(h == H_JMP && src == CNST)
+			{
+				b += 5;
+				if(!boundary[b])
+				{
+					return -1;
+				}
+				changed |= !target[b];
+				target[b] = 1;
+				continue;
+			}
+			if(h == H_JMP || h == H_ADD_PC)
+			{
+				// MOV r7, r then continues at r + 5, ADD r7, r at this address + r + 5
+				if((h == H_JMP && src != RGSTR) || b >= SP)
+				{
+					return -1;
+				}
+				for(int k = 0; k<n; ++k)
+				{
+					unsigned char t = p[k].v[b] + 5 + (h == H_ADD_PC ? i : 0);
+					if(!(p[k].known & 1<<b) || !boundary[t])
+					{
+						return -1;
+					}
+					changed |= !target[t];
+					target[t] = 1;
+				}
+				continue;
+			}
+			if(h == H_CAL)
+			{
+				n = 1;
+				p[0].known = 0;
+				continue;
+			}
+			if(a >= SP || (h != H_MOV_RC && h != H_MOV_RR && h != H_MOV_RS && h != H_MOV_RP
+				&& h != H_ADD && h != H_NOT && h != H_EQU))
+			{
+				continue;
+			}
+			for(int k = 0, m = n; k<m; ++k)
+			{
+				jump_path *q = &p[k];
+				int known = (q->known >> a) & 1, from = b < SP && (q->known >> b & 1);
+				if(h == H_EQU && !known && n < JUMP_PATHS)
+				{
+					p[n] = *q;
+					p[n].v[a] = 1;
+					p[n++].known |= 1<<a;
+					q->v[a] = 0;
+					known = 1;
+				}
+				else if(h == H_MOV_RC || h == H_MOV_RR)
+				{
+					q->v[a] = h == H_MOV_RC ? b : q->v[b < SP ? b : 0];
+					known = h == H_MOV_RC || from;
+				}
+				else if(h == H_ADD)
+				{
+					q->v[a] += q->v[b < SP ? b : 0];
+					known &= from;
+				}
+				else if(h == H_NOT || h == H_EQU)
+				{
+					q->v[a] = h == H_NOT ? ~q->v[a] : !q->v[a];
+				}
+				else
+				{
+					known = 0;
+				}
+				q->known = (q->known & ~(1<<a)) | known<<a;
+			}
+		}
+	}
+	return 0;
+}
+
+// how far above its own SP the function at entry and its callees write, -1 when that
+// cannot be bounded. a function depends only on its frame and not on who called it, so
+// each one is walked once and its depth kept in depth[], state[] is 1 while a function is
+// on the current call path and 2 once its depth is known
+int stack_reach(const unsigned char *RAM, unsigned char CS, unsigned char entry, int *depth, char *state)
+{
+	unsigned char a, b, src;
+	char boundary[1<<8] = {0};
+	char target[1<<8] = {0};
+	// per symbol, 1 + the frame offset a REF stored in it, 0 when not known
+	short ref[1<<8];
+	int len, top = 0, falls = 0;
+
+	if(state[entry] == 2)
+	{
+		return depth[entry];
+	}
+	if(entry < CS || state[entry])
+	{
+		return -1;
+	}
+	int end = func_end(RAM, CS, entry);
+	for(int i = entry; i < end; i += len)
+	{
+		decode_insn(RAM, i, &a, &b, &src, &len);
+		if(i + len > (1<<8))
+		{
+			return -1;
+		}
+		boundary[i] = 1;
+	}
+	if(jump_targets(RAM, entry, end, boundary, target) < 0)
+	{
+		return -1;
+	}
+
+	state[entry] = 1;
+	for(int i = entry; i < end && top >= 0; i += len)
+	{
+		int h = decode_insn(RAM, i, &a, &b, &src, &len);
+		// control can arrive here from elsewhere, the symbols hold whatever it left
+		if(!falls || target[i])
+		{
+			memset(ref, 0, sizeof(ref));
+		}
+		falls = h != H_RET && h != H_JMP && h != H_ADD_PC && h != H_BAD;
+		switch(h)
+		{
+			case H_MOV_RC: case H_MOV_RR: case H_MOV_RS: case H_MOV_RP:
+			case H_ADD: case H_NOT: case H_EQU:
+			if(a == SP || a == SZ)
+			{
+				top = -1;
+			}
+			break;
+
+			case H_MOV_SC: case H_MOV_SR: case H_MOV_SS: case H_MOV_SP:
+			ref[a] = 0;
+			if(a > top)
+			{
+				top = a;
+			}
+			break;
+
+			case H_REF:
+			ref[a] = 1 + b;
+			if(a > top)
+			{
+				top = a;
+			}
+			break;
+
+			case H_MOV_PC: case H_MOV_PR: case H_MOV_PS: case H_MOV_PP:
+			if(!ref[a])
+			{
+				top = -1;
+				break;
+			}
+			a = ref[a] - 1;
+			ref[a] = 0;
+			if(a > top)
+			{
+				top = a;
+			}
+			break;
+
+			// saves SZ and PC at SP and SP + 1, the callee starts right above and may
+			// write any symbol of this frame from SP on
+			case H_CAL:
+			{
+				int reach = a < 8 ? stack_reach(RAM, CS, RAM[a], depth, state) : -1;
+				if(reach < 0)
+				{
+					top = -1;
+				}
+				else if(reach + 2 > top)
+				{
+					top = reach + 2;
+				}
+				memset(ref, 0, sizeof(ref));
+			}
+			break;
+
+			case H_NOP: case H_JMP: case H_ADD_PC: case H_RET: case H_BAD:
+			case H_PRINT_C: case H_PRINT_R: case H_PRINT_S: case H_PRINT_P:
+			break;
+
+			default:
+			// H_SLOW
+			top = -1;
+		}
+	}
+	depth[entry] = top;
+	state[entry] = 2;
+	return top;
+}
+
+// the highest stack address a run from vm_reset can touch, 0 if it cannot be bounded
+// below CS
+int stack_bound(const unsigned char *RAM, unsigned char CS)
+{
+	int depth[1<<8];
+	char state[1<<8] = {0};
+	int top = stack_reach(RAM, CS, RAM[0], depth, state);
+	return top < 0 || 8 + top >= CS ? 0 : 8 + top;
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////         OPTIMIZER         ////////////////////
+//////////////////////////////////////////////////////////////
+
+// rewrites the loaded image in place. every instruction keeps its address and length, so
+// jumps, PC reads and the function table stay as they were
+//  - a register or symbol source holding a known constant becomes that constant, and an
+//    ADD of two known registers becomes a MOV of the sum
+//  - a MOV whose destination is written again before anything reads it becomes a NOP
+//    (a MOV to a constant)
+//  - symbols that are never live at the same time share a frame slot, and each function
+//    numbers its slots from 0 instead of after the symbols of the functions before it
+//
+// that is only sound when the image shows every read and write the program does, so it
+// runs on programs stack_bound can bound, over the same function ranges. a computed jump
+// has to land where jump_targets shows, and goes on at any instruction a jump of its
+// function lands on. pointers have to be set by a REF as stack_reach wants for stores,
+// loads too so they cannot see the code being rewritten, then a pointer store may write
+// any symbol and a pointer load read any. sharing slots and dropping symbol stores further
+// needs no REF or pointer operand (they expose slot addresses) and every symbol read fed by a write of
+// the same call with no CAL in between, since callee frames and the 2 saved bytes land on
+// the caller's slots
+
+// live sets: bit r for register r, bit 8 + k for the k-th symbol of the function
+#define OPT_REGS		0xFFULL
+#define OPT_SYMS		(~OPT_REGS)
+#define OPT_MAX_SYMS	56
+#define OPT_ANY			-2
+
+typedef struct
+{
+	int forwarded, folded, dropped;
+	// bytes of stack above 8 on the deepest call chain, before and after
+	int stack_before, stack_after;
+} opt_stats;
+
+// a function from its entry to the next one in the table
+typedef struct
+{
+	int n;
+	unsigned char addr[1<<8];
+	// index of the target of a constant MOV to PC, OPT_ANY for a computed jump and -1 for
+	// anything else
+	short target[1<<8];
+	// 1 for the instructions a jump lands on
+	char landing[1<<8];
+	// symbol slots in order of first appearance, and slot to index
+	unsigned char syms[OPT_MAX_SYMS];
+	int nsyms;
+	signed char sym_index[1<<8];
+	int refs, pointers;
+	unsigned long long use[1<<8], def[1<<8], live_in[1<<8], live_out[1<<8];
+} opt_func;
+
+// returns -1 on a byte that is no instruction, a jump that may leave the function or land
+// inside an instruction, a pointer not set by a REF or too many symbols
+int opt_build(const unsigned char *RAM, unsigned char CS, unsigned char entry, opt_func *f)
+{
+	short index[1<<8];
+	char boundary[1<<8] = {0}, target[1<<8];
+	memset(f, 0, sizeof(*f));
+	memset(f->sym_index, -1, sizeof(f->sym_index));
+	memset(index, -1, sizeof(index));
+
+	int end = func_end(RAM, CS, entry);
+	for(int i = entry; i < end; i += 1 + 2*layouts[RAM[i]].nargs)
+	{
+		if(RAM[i] > EQU)
+		{
+			return -1;
+		}
+		index[i] = f->n;
+		boundary[i] = 1;
+		f->addr[f->n++] = i;
+	}
+	if(jump_targets(RAM, entry, end, boundary, target) < 0)
+	{
+		return -1;
+	}
+	for(int i = 0; i<f->n; ++i)
+	{
+		const unsigned char *p = &RAM[f->addr[i]];
+		f->target[i] = -1;
+		if(p[0] == MOV && p[1] == RGSTR && p[2] == PC)
+		{
+			f->target[i] = p[3] == CNST ? index[(unsigned char)(p[4] + 5)] : OPT_ANY;
+			if(f->target[i] == -1)
+			{
+				return -1;
+			}
+		}
+		if(p[0] == ADD && p[2] == PC)
+		{
+			f->target[i] = OPT_ANY;
+		}
+		f->landing[i] = target[f->addr[i]];
+		f->pointers += (p[0] == MOV && (p[1] == PNTR || p[3] == PNTR)) || (p[0] == PRINT && p[1] == PNTR);
+		f->refs += p[0] == REF;
+		for(int k = 0; k<2; ++k)
+		{
+			unsigned char kind = p[1 + 2*k], v = p[2 + 2*k];
+			if(k < layouts[p[0]].nargs && (p[0] == MOV || p[0] == PRINT || (p[0] == REF && !k))
+				&& (kind == SYMBL || kind == PNTR) && f->sym_index[v] < 0)
+			{
+				if(f->nsyms == OPT_MAX_SYMS)
+				{
+					return -1;
+				}
+				f->sym_index[v] = f->nsyms;
+				f->syms[f->nsyms++] = v;
+			}
+		}
+	}
+
+	// same straight runs as stack_reach, 1 + the offset a REF stored in each symbol
+	char leader[1<<8] = {0};
+	short ref[1<<8];
+	for(int i = 0; i<f->n; ++i)
+	{
+		leader[i] |= f->landing[i];
+		if(f->target[i] != -1 || RAM[f->addr[i]] == RET || RAM[f->addr[i]] == CAL)
+		{
+			leader[i + 1] = 1;
+		}
+	}
+	for(int i = 0; i<f->n; ++i)
+	{
+		const unsigned char *p = &RAM[f->addr[i]];
+		if(!i || leader[i])
+		{
+			memset(ref, 0, sizeof(ref));
+		}
+		if(((p[0] == MOV && p[1] == PNTR) || (p[0] == PRINT && p[1] == PNTR)) && !ref[p[2]])
+		{
+			return -1;
+		}
+		if(p[0] == MOV && p[3] == PNTR && !ref[p[4]])
+		{
+			return -1;
+		}
+		if(p[0] == REF)
+		{
+			ref[p[2]] = 1 + p[4];
+		}
+		else if(p[0] == MOV && p[1] == SYMBL)
+		{
+			ref[p[2]] = 0;
+		}
+		else if(p[0] == MOV && p[1] == PNTR)
+		{
+			ref[ref[p[2]] - 1] = 0;
+		}
+	}
+	return 0;
+}
+
+static unsigned long long opt_operand(const opt_func *f, unsigned char kind, unsigned char v)
+{
+	if(kind == RGSTR)
+	{
+		return 1ULL << v;
+	}
+	if(kind == SYMBL)
+	{
+		return 1ULL << (8 + f->sym_index[v]);
+	}
+	// the pointer and whatever symbol it points at
+	if(kind == PNTR)
+	{
+		return OPT_SYMS;
+	}
+	return 0;
+}
+
+// use and def sets from the current bytes, then live sets to a fixed point. CAL and RET
+// read every register, the callee or caller may, and CAL kills nothing. a pointer store
+// reads its pointer and kills nothing
+void opt_liveness(const unsigned char *RAM, opt_func *f)
+{
+	for(int i = 0; i<f->n; ++i)
+	{
+		const unsigned char *p = &RAM[f->addr[i]];
+		unsigned long long use = 0, def = 0;
+		switch(p[0])
+		{
+			case MOV:
+			def = p[1] == PNTR ? 0 : opt_operand(f, p[1], p[2]);
+			use = opt_operand(f, p[3], p[4]) | (p[1] == PNTR ? opt_operand(f, SYMBL, p[2]) : 0);
+			break;
+			case REF:
+			def = opt_operand(f, SYMBL, p[2]);
+			break;
+			case ADD:
+			def = 1ULL << p[2];
+			use = 1ULL << p[2] | 1ULL << p[4];
+			break;
+			case PRINT:
+			use = opt_operand(f, p[1], p[2]);
+			break;
+			case NOT:
+			case EQU:
+			use = def = 1ULL << p[2];
+			break;
+			case CAL:
+			case RET:
+			use = OPT_REGS;
+			break;
+		}
+		f->use[i] = use;
+		f->def[i] = def;
+		f->live_in[i] = f->live_out[i] = 0;
+	}
+
+	for(int changed = 1; changed; )
+	{
+		changed = 0;
+		// where a computed jump may go
+		unsigned long long any = 0;
+		for(int i = 0; i<f->n; ++i)
+		{
+			any |= f->landing[i] ? f->live_in[i] : 0;
+		}
+		for(int i = f->n - 1; i >= 0; --i)
+		{
+			unsigned long long out = 0;
+			if(f->target[i] == OPT_ANY)
+			{
+				out = any;
+			}
+			else if(f->target[i] >= 0)
+			{
+				out = f->live_in[f->target[i]];
+			}
+			else if(i + 1 < f->n && RAM[f->addr[i]] != RET)
+			{
+				out = f->live_in[i + 1];
+			}
+			unsigned long long in = f->use[i] | (out & ~f->def[i]);
+			changed |= in != f->live_in[i] || out != f->live_out[i];
+			f->live_in[i] = in;
+			f->live_out[i] = out;
+		}
+	}
+}
+
+// constants known at each instruction, forgotten at jump targets and across CAL, and for
+// symbols across pointer stores
+void opt_forward(unsigned char *RAM, const opt_func *f, opt_stats *st)
+{
+	char leader[1<<8] = {0};
+	// r0 .. r4 in 0 .. 4, symbol slots at 8 + slot
+	char known[8 + (1<<8)];
+	unsigned char val[8 + (1<<8)];
+
+	leader[0] = 1;
+	for(int i = 0; i<f->n; ++i)
+	{
+		leader[i] |= f->landing[i];
+		if(f->target[i] != -1 || RAM[f->addr[i]] == RET)
+		{
+			leader[i + 1] = 1;
+		}
+	}
+
+	for(int i = 0; i<f->n; ++i)
+	{
+		unsigned char *p = &RAM[f->addr[i]];
+		if(leader[i] || p[0] == CAL)
+		{
+			memset(known, 0, sizeof(known));
+		}
+		// slot in known[] of a source or destination operand, -1 when not tracked
+		#define TRACKED(kind, v) ((kind) == RGSTR ? ((v) < SP ? (v) : -1) : (kind) == SYMBL ? 8 + (v) : -1)
+		switch(p[0])
+		{
+			case MOV:
+			case PRINT:
+			{
+				// the source is the second operand of MOV and the only one of PRINT
+				unsigned char *src = p[0] == MOV ? &p[3] : &p[1];
+				int s = TRACKED(src[0], src[1]);
+				if(s >= 0 && known[s])
+				{
+					src[0] = CNST;
+					src[1] = val[s];
+					st->forwarded++;
+				}
+				if(p[0] == MOV)
+				{
+					int d = TRACKED(p[1], p[2]);
+					if(d >= 0)
+					{
+						known[d] = p[3] == CNST;
+						val[d] = p[4];
+					}
+					if(p[1] == PNTR)
+					{
+						memset(known + 8, 0, 1<<8);
+					}
+				}
+			}
+			break;
+
+			case REF:
+			known[8 + p[2]] = 0;
+			break;
+
+			case ADD:
+			if(p[4] < SP && known[p[2]] && known[p[4]])
+			{
+				val[p[2]] += val[p[4]];
+				p[0] = MOV;
+				p[3] = CNST;
+				p[4] = val[p[2]];
+				st->folded++;
+			}
+			else
+			{
+				known[p[2]] = 0;
+			}
+			break;
+
+			case NOT:
+			val[p[2]] = ~val[p[2]];
+			break;
+
+			case EQU:
+			val[p[2]] = !val[p[2]];
+			break;
+		}
+		#undef TRACKED
+	}
+}
+
+// MOVs to a register below SP, or to a symbol when frames are clean, that nothing reads
+void opt_drop(unsigned char *RAM, const opt_func *f, int frames, opt_stats *st)
+{
+	for(int i = 0; i<f->n; ++i)
+	{
+		unsigned char *p = &RAM[f->addr[i]];
+		if(p[0] == MOV && ((p[1] == RGSTR && p[2] < SP) || (p[1] == SYMBL && frames)) && !(f->def[i] & f->live_out[i]))
+		{
+			p[1] = CNST;
+			st->dropped++;
+		}
+	}
+}
+
+// colours the interference graph of the symbols in order of first appearance, lowest
+// free slot first, and renames every symbol operand to its colour
+void opt_rename(unsigned char *RAM, const opt_func *f)
+{
+	unsigned long long adj[OPT_MAX_SYMS] = {0};
+	unsigned char color[OPT_MAX_SYMS];
+
+	for(int i = 0; i<f->n; ++i)
+	{
+		unsigned long long d = f->def[i] & OPT_SYMS, out = f->live_out[i] & OPT_SYMS & ~d;
+		if(!d)
+		{
+			continue;
+		}
+		int k = __builtin_ctzll(d) - 8;
+		adj[k] |= out;
+		for(int j = 0; j<f->nsyms; ++j)
+		{
+			if(out >> (8 + j) & 1)
+			{
+				adj[j] |= d;
+			}
+		}
+	}
+	for(int k = 0; k<f->nsyms; ++k)
+	{
+		unsigned long long taken = 0;
+		for(int j = 0; j<k; ++j)
+		{
+			if(adj[k] >> (8 + j) & 1)
+			{
+				taken |= 1ULL << color[j];
+			}
+		}
+		color[k] = __builtin_ctzll(~taken);
+	}
+
+	for(int i = 0; i<f->n; ++i)
+	{
+		unsigned char *p = &RAM[f->addr[i]];
+		for(int k = 0; k<2 && k < layouts[p[0]].nargs; ++k)
+		{
+			if((p[0] == MOV || p[0] == PRINT) && p[1 + 2*k] == SYMBL)
+			{
+				p[2 + 2*k] = color[f->sym_index[p[2 + 2*k]]];
+			}
+		}
+	}
+}
+
+// runs the passes over the functions reachable from main and bounds the stack again.
+// returns 0, or -1 with the image untouched when the program is out of their reach
+int optimize_image(vm_context *vm, opt_stats *st)
+{
+	unsigned char *RAM = vm->image;
+	memset(st, 0, sizeof(*st));
+	if(!vm->stack_top)
+	{
+		return -1;
+	}
+
+	opt_func *funcs = malloc(8*sizeof(opt_func));
+	unsigned char owner[1<<8] = {0};
+	int labels[8], count = 0, frames = 1;
+	unsigned char seen = 1;
+
+	// functions reachable through CAL, none sharing code
+	labels[count++] = 0;
+	for(int k = 0; k<count; ++k)
+	{
+		opt_func *f = &funcs[k];
+		if(opt_build(RAM, vm->CS, RAM[labels[k]], f) < 0)
+		{
+			free(funcs);
+			return -1;
+		}
+		for(int i = 0; i<f->n; ++i)
+		{
+			const unsigned char *p = &RAM[f->addr[i]];
+			if(owner[f->addr[i]])
+			{
+				free(funcs);
+				return -1;
+			}
+			owner[f->addr[i]] = k + 1;
+			if(p[0] == CAL && !(seen >> p[2] & 1))
+			{
+				seen |= 1 << p[2];
+				labels[count++] = p[2];
+			}
+		}
+		frames &= !f->refs && !f->pointers;
+	}
+
+	for(int k = 0; k<count; ++k)
+	{
+		opt_forward(RAM, &funcs[k], st);
+	}
+	for(int k = 0; k<count; ++k)
+	{
+		opt_func *f = &funcs[k];
+		opt_liveness(RAM, f);
+		frames &= !(f->live_in[0] & OPT_SYMS);
+		for(int i = 0; i<f->n; ++i)
+		{
+			frames &= RAM[f->addr[i]] != CAL || !(f->live_out[i] & OPT_SYMS);
+		}
+	}
+	for(int k = 0; k<count; ++k)
+	{
+		opt_drop(RAM, &funcs[k], frames, st);
+		if(frames)
+		{
+			opt_liveness(RAM, &funcs[k]);
+			opt_rename(RAM, &funcs[k]);
+		}
+	}
+	free(funcs);
+
+	st->stack_before = vm->stack_top - 8;
+	vm->stack_top = stack_bound(RAM, vm->CS);
+	st->stack_after = vm->stack_top - 8;
+	return 0;
+}
+
+#undef OPT_REGS
+#undef OPT_SYMS
+#undef OPT_MAX_SYMS
+#undef OPT_ANY
+
+
+//////////////////////////////////////////////////////////////
+///////////////        NATIVE TIER        ////////////////////
+//////////////////////////////////////////////////////////////
+
+// a function called JIT_THRESHOLD times is compiled to x86-64 and from then on entered
+// natively from CAL, and from RET when returning into it. VM registers r0 .. r6 stay in
+// host registers for the whole native run, stack and pointer operands are loads and stores
+// off r15 (RAM), and computed jumps go through entry, the native address of every
+// compiled instruction by VM address
+//
+// CAL and RET stay native when the callee, or the instruction returned to, was compiled
+// too. native code hands back to the interpreter with PC at the instruction to run next
+// for a CAL of a function not compiled yet (the interpreter counts it), main returning,
+// whatever vm_step handles, a store into the code segment (left undone, the interpreter
+// redoes it, CAL included when its frame would reach code), a write to SP or SZ or a
+// CAL / RET that overflows the stack, and a jump to an address that was not compiled.
+// any store into code drops all native code
+
+#define JIT_THRESHOLD	64
+#define JIT_BUFFER		(1<<16)
+
+typedef struct vm_jit
+{
+	// JIT_BUFFER bytes, the enter and exit stubs first, then functions from base to used
+	unsigned char *buf;
+	size_t used, base, exit;
+	void *entry[1<<8];
+	// CAL count per function entry address
+	unsigned int calls[1<<8];
+	// set once code changed under a run, the next program start has to flush
+	int smc;
+	// loads the VM registers and jumps to target, they are stored back (with PC) on exit
+	void (*enter)(unsigned char *RAM, unsigned char *regs, void *target, vm_context *vm);
+} vm_jit;
+
+void jit_flush(vm_jit *j)
+{
+	memset(j->entry, 0, sizeof(j->entry));
+	memset(j->calls, 0, sizeof(j->calls));
+	j->used = j->base;
+	j->smc = 0;
+}
+
+void jit_code_changed(vm_jit *j)
+{
+	jit_flush(j);
+	j->smc = 1;
+}
+
+void jit_print(vm_context *vm, unsigned char value)
+{
+	vm_print(vm, value);
+}
+
+#if defined(__x86_64__)
+
+// host register of VM r0 .. r6 : ebx, ebp, r12d, r13d, r14d, r8d, r9d
+static const unsigned char host_reg[7] = {3, 5, 12, 13, 14, 8, 9};
+
+#define JIT_EMIT(j, ...) do { static const unsigned char b_[] = {__VA_ARGS__}; \
+	memcpy((j)->buf + (j)->used, b_, sizeof(b_)); (j)->used += sizeof(b_); } while(0)
+
+static void jit_byte(vm_jit *j, unsigned char b)
+{
+	j->buf[j->used++] = b;
+}
+
+static void jit_u32(vm_jit *j, unsigned int v)
+{
+	memcpy(j->buf + j->used, &v, 4);
+	j->used += 4;
+}
+
+static void jit_u64(vm_jit *j, unsigned long long v)
+{
+	memcpy(j->buf + j->used, &v, 8);
+	j->used += 8;
+}
+
+// rel32 to a buffer offset, counted from the end of the field
+static void jit_rel32(vm_jit *j, size_t target)
+{
+	jit_u32(j, (unsigned int)(target - (j->used + 4)));
+}
+
+// REX for a byte operation between host registers r (modrm reg) and b (modrm rm).
+// spl .. dil are only reachable as bytes with one
+static void jit_rex8(vm_jit *j, int r, int b)
+{
+	if(r >= 4 || b >= 4)
+	{
+		jit_byte(j, 0x40 | (r >> 3) << 2 | (b >> 3));
+	}
+}
+
+// op r/m8, r8 (0x88 mov, 0x00 add, 0x84 test)
+static void jit_rr8(vm_jit *j, unsigned char op, int dst, int src)
+{
+	jit_rex8(j, src, dst);
+	jit_byte(j, op);
+	jit_byte(j, 0xC0 | (src & 7) << 3 | (dst & 7));
+}
+
+// movzx r32, r8
+static void jit_movzx(vm_jit *j, int dst, int src)
+{
+	jit_rex8(j, dst, src);
+	JIT_EMIT(j, 0x0F, 0xB6);
+	jit_byte(j, 0xC0 | (dst & 7) << 3 | (src & 7));
+}
+
+// mov al, pc ; jmp exit
+static void jit_exit(vm_jit *j, unsigned char pc)
+{
+	jit_byte(j, 0xB0);
+	jit_byte(j, pc);
+	jit_byte(j, 0xE9);
+	jit_rel32(j, j->exit);
+}
+
+// leaves at pc unless ecx < bound
+static void jit_exit_unless_below(vm_jit *j, unsigned int bound, unsigned char pc)
+{
+	JIT_EMIT(j, 0x81, 0xF9);
+	jit_u32(j, bound);
+	JIT_EMIT(j, 0x72, 0x07);
+	jit_exit(j, pc);
+}
+
+// ecx = (SP + v) & 0xFF
+static void jit_sym_addr(vm_jit *j, unsigned char v)
+{
+	jit_movzx(j, 1, host_reg[SP]);
+	if(v)
+	{
+		JIT_EMIT(j, 0x80, 0xC1);
+		jit_byte(j, v);
+		JIT_EMIT(j, 0x0F, 0xB6, 0xC9);
+	}
+}
+
+// al = operand
+static void jit_load(vm_jit *j, int kind, unsigned char v)
+{
+	switch(kind)
+	{
+		case CNST:
+		jit_byte(j, 0xB0);
+		jit_byte(j, v);
+		break;
+
+		case RGSTR:
+		jit_rr8(j, 0x88, 0, host_reg[v]);
+		break;
+
+		default:
+		jit_sym_addr(j, v);
+		// mov al, [r15 + rcx]
+		JIT_EMIT(j, 0x41, 0x8A, 0x04, 0x0F);
+		if(kind == PNTR)
+		{
+			// movzx ecx, al ; mov al, [r15 + rcx]
+			JIT_EMIT(j, 0x0F, 0xB6, 0xC8, 0x41, 0x8A, 0x04, 0x0F);
+		}
+	}
+}
+
+// leaves at next if SP + SZ reached the code segment, as the interpreter checks it there
+static void jit_stack_check(vm_jit *j, unsigned char CS, unsigned char next)
+{
+	jit_movzx(j, 1, host_reg[SP]);
+	jit_movzx(j, 0, host_reg[SZ]);
+	// add ecx, eax
+	JIT_EMIT(j, 0x01, 0xC1);
+	jit_exit_unless_below(j, CS, next);
+}
+
+// SP and SZ are the only registers whose writes can end a native run
+static void jit_reg_written(vm_jit *j, unsigned char r, unsigned char CS, unsigned char next)
+{
+	if(r == SP || r == SZ)
+	{
+		jit_stack_check(j, CS, next);
+	}
+}
+
+// operand = al. a store into the code segment leaves at pc before anything is written
+static void jit_store(vm_jit *j, int kind, unsigned char v, unsigned char CS, unsigned char pc, unsigned char next)
+{
+	if(kind == RGSTR)
+	{
+		jit_rr8(j, 0x88, host_reg[v], 0);
+		jit_reg_written(j, v, CS, next);
+		return;
+	}
+	jit_sym_addr(j, v);
+	if(kind == PNTR)
+	{
+		// movzx ecx, byte [r15 + rcx]
+		JIT_EMIT(j, 0x41, 0x0F, 0xB6, 0x0C, 0x0F);
+	}
+	jit_exit_unless_below(j, CS, pc);
+	// mov [r15 + rcx], al
+	JIT_EMIT(j, 0x41, 0x88, 0x04, 0x0F);
+}
+
+// leaves with the PC already in al if SP + SZ reached the code segment
+static void jit_stack_check_al(vm_jit *j, unsigned char CS)
+{
+	// movzx ecx, SP ; movzx edx, SZ ; add ecx, edx ; cmp ecx, CS ; jb +5 ; jmp exit
+	jit_movzx(j, 1, host_reg[SP]);
+	jit_movzx(j, 2, host_reg[SZ]);
+	JIT_EMIT(j, 0x01, 0xD1, 0x81, 0xF9);
+	jit_u32(j, CS);
+	JIT_EMIT(j, 0x72, 0x05, 0xE9);
+	jit_rel32(j, j->exit);
+}
+
+// CAL of table slot x at pc, saving SZ and next at SP + SZ
+static void jit_call(vm_jit *j, unsigned char x, unsigned char CS, unsigned char pc, unsigned char next)
+{
+	// movzx eax, byte [r15 + x] ; mov r11, entry ; mov r11, [r11 + rax*8] ; test r11, r11 ;
+	// jnz +7 ; leave at pc for the interpreter to count the call
+	JIT_EMIT(j, 0x41, 0x0F, 0xB6, 0x87);
+	jit_u32(j, x);
+	JIT_EMIT(j, 0x49, 0xBB);
+	jit_u64(j, (unsigned long long)j->entry);
+	JIT_EMIT(j, 0x4D, 0x8B, 0x1C, 0xC3, 0x4D, 0x85, 0xDB, 0x75, 0x07);
+	jit_exit(j, pc);
+	// ecx = SP + SZ, both saved bytes below CS or the interpreter does it
+	jit_movzx(j, 1, host_reg[SP]);
+	jit_movzx(j, 2, host_reg[SZ]);
+	JIT_EMIT(j, 0x01, 0xD1, 0x81, 0xF9);
+	jit_u32(j, CS - 1);
+	JIT_EMIT(j, 0x72, 0x07);
+	jit_exit(j, pc);
+	// mov [r15 + rcx], SZ ; mov byte [r15 + rcx + 1], next
+	jit_rex8(j, host_reg[SZ], 15);
+	jit_byte(j, 0x88);
+	jit_byte(j, 0x04 | (host_reg[SZ] & 7) << 3);
+	JIT_EMIT(j, 0x0F, 0x41, 0xC6, 0x44, 0x0F, 0x01);
+	jit_byte(j, next);
+	// SP = cl + 2
+	jit_rr8(j, 0x88, host_reg[SP], 1);
+	jit_rex8(j, 0, host_reg[SP]);
+	jit_byte(j, 0x80);
+	jit_byte(j, 0xC0 | (host_reg[SP] & 7));
+	jit_byte(j, 2);
+	// the interpreter reads the table after saving, and a frame below 8 overwrites it.
+	// cmp al, [r15 + x] ; je +13 ; movzx eax, byte [r15 + x] ; jmp exit
+	JIT_EMIT(j, 0x41, 0x3A, 0x87);
+	jit_u32(j, x);
+	JIT_EMIT(j, 0x74, 0x0D, 0x41, 0x0F, 0xB6, 0x87);
+	jit_u32(j, x);
+	jit_byte(j, 0xE9);
+	jit_rel32(j, j->exit);
+	jit_stack_check_al(j, CS);
+	// jmp r11
+	JIT_EMIT(j, 0x41, 0xFF, 0xE3);
+}
+
+// RET, main returning leaves for the interpreter to end the run
+static void jit_return(vm_jit *j, unsigned char CS, unsigned char pc)
+{
+	// cmp SP, 8 ; jne +7
+	jit_rex8(j, 0, host_reg[SP]);
+	jit_byte(j, 0x80);
+	jit_byte(j, 0xF8 | (host_reg[SP] & 7));
+	JIT_EMIT(j, 0x08, 0x75, 0x07);
+	jit_exit(j, pc);
+	// SZ = [SP - 2] ; al = [SP - 1] ; SP -= 2 + SZ
+	jit_sym_addr(j, 0xFE);
+	jit_rex8(j, host_reg[SZ], 15);
+	jit_byte(j, 0x8A);
+	jit_byte(j, 0x04 | (host_reg[SZ] & 7) << 3);
+	jit_byte(j, 0x0F);
+	jit_sym_addr(j, 0xFF);
+	JIT_EMIT(j, 0x41, 0x8A, 0x04, 0x0F);
+	jit_rex8(j, 0, host_reg[SP]);
+	jit_byte(j, 0x80);
+	jit_byte(j, 0xE8 | (host_reg[SP] & 7));
+	jit_byte(j, 2);
+	jit_rr8(j, 0x28, host_reg[SP], host_reg[SZ]);
+	jit_stack_check_al(j, CS);
+}
+
+// jumps to the VM address in al, leaving when it was not compiled
+static void jit_dispatch(vm_jit *j)
+{
+	// movzx eax, al ; mov rcx, entry ; mov rcx, [rcx + rax*8] ; test rcx, rcx ; jz exit ; jmp rcx
+	JIT_EMIT(j, 0x0F, 0xB6, 0xC0, 0x48, 0xB9);
+	jit_u64(j, (unsigned long long)j->entry);
+	JIT_EMIT(j, 0x48, 0x8B, 0x0C, 0xC1, 0x48, 0x85, 0xC9, 0x0F, 0x84);
+	jit_rel32(j, j->exit);
+	JIT_EMIT(j, 0xFF, 0xE1);
+}
+
+vm_jit *jit_create(void)
+{
+	unsigned char *buf = mmap(NULL, JIT_BUFFER, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(buf == MAP_FAILED)
+	{
+		return NULL;
+	}
+	vm_jit *j = calloc(1, sizeof(vm_jit));
+	j->buf = buf;
+
+	// enter(RAM = rdi, regs = rsi, target = rdx, vm = rcx)
+	// push rbx, rbp, r12 .. r15 ; sub rsp, 24 ; [rsp] = regs ; [rsp + 8] = vm ; r15 = RAM
+	JIT_EMIT(j, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x48, 0x83, 0xEC, 0x18,
+		0x48, 0x89, 0x34, 0x24, 0x48, 0x89, 0x4C, 0x24, 0x08, 0x49, 0x89, 0xFF);
+	for(int r = 0; r<7; ++r)
+	{
+		// movzx host, byte [rsi + r]
+		jit_rex8(j, host_reg[r], 0);
+		JIT_EMIT(j, 0x0F, 0xB6);
+		jit_byte(j, 0x46 | (host_reg[r] & 7) << 3);
+		jit_byte(j, r);
+	}
+	// jmp rdx
+	JIT_EMIT(j, 0xFF, 0xE2);
+
+	// exit, PC in al: store everything back and undo the prologue
+	j->exit = j->used;
+	// mov rsi, [rsp] ; mov [rsi + 7], al
+	JIT_EMIT(j, 0x48, 0x8B, 0x34, 0x24, 0x88, 0x46, 0x07);
+	for(int r = 0; r<7; ++r)
+	{
+		jit_rex8(j, host_reg[r], 6);
+		jit_byte(j, 0x88);
+		jit_byte(j, 0x46 | (host_reg[r] & 7) << 3);
+		jit_byte(j, r);
+	}
+	JIT_EMIT(j, 0x48, 0x83, 0xC4, 0x18, 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+
+	j->base = j->used;
+	j->enter = (void *)j->buf;
+	mprotect(j->buf, JIT_BUFFER, PROT_READ | PROT_EXEC);
+	return j;
+}
+
+// compiles the function at entry, from there up to its RET
+void jit_compile(vm_jit *j, const unsigned char *RAM, unsigned char CS, unsigned char entry)
+{
+	unsigned char at[1<<8], a[1<<8], b[1<<8], src[1<<8], next[1<<8], h[1<<8];
+	char boundary[1<<8] = {0};
+	size_t native[1<<8];
+	int count = 0, len;
+
+	if(entry < CS)
+	{
+		return;
+	}
+	for(int i = entry; i < (1<<8); i += len)
+	{
+		int k = decode_insn(RAM, i, &a[i], &b[i], &src[i], &len);
+		if(k == H_BAD || i + len > (1<<8))
+		{
+			break;
+		}
+		h[i] = k;
+		next[i] = i + len;
+		boundary[i] = 1;
+		at[count++] = i;
+		if(k == H_RET)
+		{
+			break;
+		}
+	}
+	if(!count)
+	{
+		return;
+	}
+
+	// at most 124 bytes per instruction, for a CAL
+	if(j->used + 128*count > JIT_BUFFER)
+	{
+		jit_flush(j);
+	}
+	mprotect(j->buf, JIT_BUFFER, PROT_READ | PROT_WRITE);
+
+	size_t patch[1<<8];
+	unsigned char patch_to[1<<8];
+	int patches = 0;
+
+	// jmp to a compiled instruction, or leave for anything else
+	#define JUMP_TO(t) do { unsigned char t_ = (t); if(boundary[t_]) { jit_byte(j, 0xE9); \
+		patch[patches] = j->used; patch_to[patches++] = t_; jit_u32(j, 0); } else jit_exit(j, t_); } while(0)
+
+	for(int n = 0; n<count; ++n)
+	{
+		unsigned char p = at[n], x = a[p], y = b[p];
+		native[p] = j->used;
+		switch(h[p])
+		{
+			case H_NOP:
+			break;
+
+			case H_MOV_RC: case H_MOV_RR: case H_MOV_RS: case H_MOV_RP:
+			case H_MOV_SC: case H_MOV_SR: case H_MOV_SS: case H_MOV_SP:
+			case H_MOV_PC: case H_MOV_PR: case H_MOV_PS: case H_MOV_PP:
+			if(h[p] == H_MOV_RR)
+			{
+				jit_rr8(j, 0x88, host_reg[x], host_reg[y]);
+				jit_reg_written(j, x, CS, next[p]);
+				break;
+			}
+			jit_load(j, (h[p] - H_MOV_RC) & 3, y);
+			jit_store(j, RGSTR + (h[p] - H_MOV_RC)/4, x, CS, p, next[p]);
+			// MOV r, c ; ADD r7, r is a relative jump by a constant, the ADD keeps its own
+			// dispatching code for anything jumping to it directly
+			if(h[p] == H_MOV_RC && boundary[next[p]] && h[next[p]] == H_ADD_PC && b[next[p]] == x)
+			{
+				JUMP_TO(next[p] + 5 + y);
+				continue;
+			}
+			break;
+
+			case H_REF:
+			// mov al, SP ; add al, y
+			jit_rr8(j, 0x88, 0, host_reg[SP]);
+			jit_byte(j, 0x04);
+			jit_byte(j, y);
+			jit_store(j, SYMBL, x, CS, p, next[p]);
+			break;
+
+			case H_ADD:
+			jit_rr8(j, 0x00, host_reg[x], host_reg[y]);
+			jit_reg_written(j, x, CS, next[p]);
+			break;
+
+			case H_NOT:
+			jit_rex8(j, 0, host_reg[x]);
+			jit_byte(j, 0xF6);
+			jit_byte(j, 0xD0 | (host_reg[x] & 7));
+			jit_reg_written(j, x, CS, next[p]);
+			break;
+
+			case H_EQU:
+			// test r, r ; sete r
+			jit_rr8(j, 0x84, host_reg[x], host_reg[x]);
+			jit_rex8(j, 0, host_reg[x]);
+			JIT_EMIT(j, 0x0F, 0x94);
+			jit_byte(j, 0xC0 | (host_reg[x] & 7));
+			jit_reg_written(j, x, CS, next[p]);
+			break;
+
+			case H_PRINT_C: case H_PRINT_R: case H_PRINT_S: case H_PRINT_P:
+			jit_load(j, h[p] - H_PRINT_C, x);
+			// push r8 ; push r9 ; mov rdi, [rsp + 24] ; movzx esi, al ; mov rax, jit_print
+			JIT_EMIT(j, 0x41, 0x50, 0x41, 0x51, 0x48, 0x8B, 0x7C, 0x24, 0x18, 0x0F, 0xB6, 0xF0, 0x48, 0xB8);
+			jit_u64(j, (unsigned long long)jit_print);
+			// call rax ; pop r9 ; pop r8
+			JIT_EMIT(j, 0xFF, 0xD0, 0x41, 0x59, 0x41, 0x58);
+			break;
+
+			// MOV into PC lands 5 past the value
+			case H_JMP:
+			if(src[p] == CNST)
+			{
+				JUMP_TO(y + 5);
+				continue;
+			}
+			jit_load(j, src[p], y);
+			JIT_EMIT(j, 0x04, 0x05);
+			jit_dispatch(j);
+			continue;
+
+			case H_ADD_PC:
+			// adding 0 is the usual not taken branch, jz straight to the next instruction
+			if(boundary[next[p]])
+			{
+				jit_rr8(j, 0x84, host_reg[y], host_reg[y]);
+				JIT_EMIT(j, 0x0F, 0x84);
+				patch[patches] = j->used;
+				patch_to[patches++] = next[p];
+				jit_u32(j, 0);
+			}
+			jit_rr8(j, 0x88, 0, host_reg[y]);
+			jit_byte(j, 0x04);
+			jit_byte(j, p + 5);
+			jit_dispatch(j);
+			continue;
+
+			case H_CAL:
+			jit_call(j, x, CS, p, next[p]);
+			continue;
+
+			case H_RET:
+			jit_return(j, CS, p);
+			jit_dispatch(j);
+			continue;
+
+			default:
+			// H_SLOW
+			jit_exit(j, p);
+			continue;
+		}
+		// falling off the last instruction leaves at the next one
+		if(n + 1 == count || at[n + 1] != next[p])
+		{
+			jit_exit(j, next[p]);
+		}
+	}
+
+	for(int k = 0; k<patches; ++k)
+	{
+		unsigned int rel = native[patch_to[k]] - (patch[k] + 4);
+		memcpy(j->buf + patch[k], &rel, 4);
+	}
+	#undef JUMP_TO
+	for(int n = 0; n<count; ++n)
+	{
+		j->entry[at[n]] = j->buf + native[at[n]];
+	}
+	mprotect(j->buf, JIT_BUFFER, PROT_READ | PROT_EXEC);
+}
+
+void jit_destroy(vm_jit *j)
+{
+	if(j)
+	{
+		munmap(j->buf, JIT_BUFFER);
+		free(j);
+	}
+}
+
+#else
+
+vm_jit *jit_create(void)
+{
+	return NULL;
+}
+
+void jit_compile(vm_jit *j, const unsigned char *RAM, unsigned char CS, unsigned char entry)
+{
+}
+
+void jit_destroy(vm_jit *j)
+{
+}
+
+#endif
+
+
+// runs from reg_bank[PC] until main returns (1), the stack reaches the code segment (-1)
+// or PC lands on something that is not an instruction (0)
+// with tracing on every entry points at the tracing hook, which records and then jumps to
+// the real handler. with tracing off the hook is never reached, so the plain loop pays nothing
+int vm_run(vm_context *vm)
+{
+	static const void *labels[H_COUNT] = {
+		[H_DECODE] = &&do_decode, [H_SLOW] = &&do_slow, [H_BAD] = &&do_bad, [H_NOP] = &&do_nop,
+		[H_MOV_RC] = &&mov_rc, [H_MOV_RR] = &&mov_rr, [H_MOV_RS] = &&mov_rs, [H_MOV_RP] = &&mov_rp,
+		[H_MOV_SC] = &&mov_sc, [H_MOV_SR] = &&mov_sr, [H_MOV_SS] = &&mov_ss, [H_MOV_SP] = &&mov_sp,
+		[H_MOV_PC] = &&mov_pc, [H_MOV_PR] = &&mov_pr, [H_MOV_PS] = &&mov_ps, [H_MOV_PP] = &&mov_pp,
+		[H_JMP] = &&do_jmp, [H_CAL] = &&do_cal, [H_RET] = &&do_ret, [H_REF] = &&do_ref,
+		[H_ADD] = &&do_add, [H_ADD_PC] = &&do_add_pc,
+		[H_PRINT_C] = &&print_c, [H_PRINT_R] = &&print_r, [H_PRINT_S] = &&print_s, [H_PRINT_P] = &&print_p,
+		[H_NOT] = &&do_not, [H_EQU] = &&do_equ,
+		[H_MOV_ADD] = &&mov_add, [H_NOT_EQU] = &&not_equ,
+	};
+
+	decoded_insn code[1<<8];
+	unsigned char *RAM = vm->RAM, *regs = vm->reg_bank;
+	unsigned char CS = vm->CS;
+	vm_trace *trace = vm->trace;
+	unsigned char pc = regs[PC], at;
+	int len, t;
+	// how far back a store into code has to drop entries, a fused pair spans up to 10
+	// bytes and an entry linked past NOPs covers them too
+	int span_max = 10;
+	const void *hook = trace && (trace->level != TRACE_OFF || trace->prof) ? &&trace_hook : NULL;
+	vm_jit *jit = hook ? NULL : vm->jit;
+	int bounded = vm->stack_top > 0;
+
+	for(int i = 0; i<(1<<8); ++i)
+	{
+		code[i].handler = labels[H_DECODE];
+	}
+
+	// translation pass, each function from its entry up to its RET
+	for(int j = 0; j<8; ++j)
+	{
+		int i = RAM[j];
+		if(!i || i < CS)
+		{
+			continue;
+		}
+		while(i < (1<<8) && code[i].handler == labels[H_DECODE])
+		{
+			decoded_insn *d = &code[i];
+			int h = decode_insn(RAM, i, &d->a, &d->b, &d->src, &len);
+			if(i + len > (1<<8))
+			{
+				break;
+			}
+			// the second of a fused pair and skipped NOPs still get their own entries below,
+			// for jumps into them. tracing counts every instruction, so nothing is fused or
+			// skipped then
+			int span = len;
+			if(!hook)
+			{
+				h = fuse_insn(RAM, i, h, d, &span);
+				span = skip_nops(RAM, i + span) - i;
+				span_max = span > span_max ? span : span_max;
+			}
+			d->handler = hook ? hook : labels[h];
+			d->h = h;
+			d->next = i + span;
+			if(h == H_RET)
+			{
+				break;
+			}
+			i += len;
+		}
+	}
+
+	#define RECORD() do { if(trace->ring) trace->ring[trace->head % TRACE_RING] = \
+		pc | RAM[pc] << 8 | regs[SP] << 16 | (unsigned int)regs[SZ] << 24; trace->head++; \
+		if(trace->prof) prof_insn(trace->prof, RAM, regs, pc, trace->head); } while(0)
+	#define D code[pc]
+	#define SYM(v) RAM[(unsigned char)(regs[SP] + (v))]
+	// SP + SZ only moves on CAL, RET, register writes to SP or SZ and in vm_step, so the
+	// overflow check runs after those and not before every instruction. a bounded program
+	// needs none at all
+	#define NEXT(n) do { pc = (n); goto *code[pc].handler; } while(0)
+	#define NEXT_CHECKED(n) do { pc = (n); if(!bounded && regs[SP] + regs[SZ] >= CS) return -1; \
+		goto *code[pc].handler; } while(0)
+	#define NEXT_REG(r, n) do { if((r) >= SP) NEXT_CHECKED(n); NEXT(n); } while(0)
+	#define FLUSH() do { for(int k = CS; k<(1<<8); ++k) code[k].handler = labels[H_DECODE]; \
+		if(jit) jit_code_changed(jit); } while(0)
+	#define STORE(addr, v) do { at = (addr); RAM[at] = (v); if(at >= CS) { \
+		for(int k = 0; k<span_max && at - k >= CS; ++k) code[at - k].handler = labels[H_DECODE]; \
+		if(jit) jit_code_changed(jit); } } while(0)
+
+	NEXT_CHECKED(pc);
+
+	do_decode:
+	{
+		decoded_insn tmp;
+		int h = decode_insn(RAM, pc, &tmp.a, &tmp.b, &tmp.src, &len);
+		if(h == H_BAD)
+		{
+			return 0;
+		}
+		// outside the code segment, or wrapping past the top of RAM: never cached
+		if(pc < CS || pc + len > (1<<8))
+		{
+			if(hook)
+			{
+				RECORD();
+			}
+			goto do_slow;
+		}
+		if(!hook)
+		{
+			h = fuse_insn(RAM, pc, h, &tmp, &len);
+			len = skip_nops(RAM, pc + len) - pc;
+			span_max = len > span_max ? len : span_max;
+		}
+		tmp.handler = hook ? hook : labels[h];
+		tmp.h = h;
+		tmp.next = pc + len;
+		code[pc] = tmp;
+		goto *tmp.handler;
+	}
+
+	trace_hook:
+	RECORD();
+	goto *labels[D.h];
+
+	do_slow:
+	regs[PC] = pc;
+	t = vm_step(vm);
+	if(t)
+	{
+		return t;
+	}
+	// vm_step can store anywhere
+	FLUSH();
+	NEXT_CHECKED(regs[PC]);
+
+	do_bad:
+	return 0;
+
+	do_nop:
+	NEXT(D.next);
+
+	mov_rc: regs[D.a] = D.b; NEXT_REG(D.a, D.next);
+	mov_rr: regs[D.a] = regs[D.b]; NEXT_REG(D.a, D.next);
+	mov_rs: regs[D.a] = SYM(D.b); NEXT_REG(D.a, D.next);
+	mov_rp: regs[D.a] = RAM[SYM(D.b)]; NEXT_REG(D.a, D.next);
+	mov_sc: STORE(regs[SP] + D.a, D.b); NEXT(D.next);
+	mov_sr: STORE(regs[SP] + D.a, regs[D.b]); NEXT(D.next);
+	mov_ss: STORE(regs[SP] + D.a, SYM(D.b)); NEXT(D.next);
+	mov_sp: STORE(regs[SP] + D.a, RAM[SYM(D.b)]); NEXT(D.next);
+	mov_pc: STORE(SYM(D.a), D.b); NEXT(D.next);
+	mov_pr: STORE(SYM(D.a), regs[D.b]); NEXT(D.next);
+	mov_ps: STORE(SYM(D.a), SYM(D.b)); NEXT(D.next);
+	mov_pp: STORE(SYM(D.a), RAM[SYM(D.b)]); NEXT(D.next);
+
+	// MOV into PC, the usual PC += 5 still applies on top of the stored value
+	do_jmp:
+	NEXT(read_val(RAM, regs[SP], regs, D.src, D.b) + 5);
+
+	do_cal:
+	STORE(regs[SP] + regs[SZ], regs[SZ]);
+	STORE(regs[SP] + regs[SZ] + 1, D.next);
+	regs[SP] += regs[SZ] + 2;
+	pc = RAM[D.a];
+	if(jit)
+	{
+		if(!jit->entry[pc] && ++jit->calls[pc] == JIT_THRESHOLD)
+		{
+			jit_compile(jit, RAM, CS, pc);
+		}
+		if(jit->entry[pc])
+		{
+			goto do_native;
+		}
+	}
+	NEXT_CHECKED(pc);
+
+	do_ret:
+	if(regs[SP] == 8)
+	{
+		return 1;
+	}
+	regs[SZ] = RAM[(unsigned char)(regs[SP] - 2)];
+	pc = RAM[(unsigned char)(regs[SP] - 1)];
+	regs[SP] = regs[SP] - 2 - regs[SZ];
+	if(jit && jit->entry[pc])
+	{
+		goto do_native;
+	}
+	NEXT_CHECKED(pc);
+
+	// runs until native code hands back, with everything stored to regs
+	do_native:
+	if(!bounded && regs[SP] + regs[SZ] >= CS)
+	{
+		return -1;
+	}
+	jit->enter(RAM, regs, jit->entry[pc], vm);
+	NEXT_CHECKED(regs[PC]);
+
+	do_ref:
+	STORE(regs[SP] + D.a, regs[SP] + D.b);
+	NEXT(D.next);
+
+	do_add:
+	regs[D.a] += regs[D.b];
+	NEXT_REG(D.a, D.next);
+
+	do_add_pc:
+	pc += regs[D.b];
+	NEXT((unsigned char)(pc + 5));
+
+	print_c: vm_print(vm, D.a); NEXT(D.next);
+	print_r: vm_print(vm, regs[D.a]); NEXT(D.next);
+	print_s: vm_print(vm, SYM(D.a)); NEXT(D.next);
+	print_p: vm_print(vm, RAM[SYM(D.a)]); NEXT(D.next);
+
+	do_not:
+	regs[D.a] = ~regs[D.a];
+	NEXT_REG(D.a, D.next);
+
+	do_equ:
+	regs[D.a] = !regs[D.a];
+	NEXT_REG(D.a, D.next);
+
+	mov_add:
+	regs[D.a] = D.b;
+	regs[D.src] += D.b;
+	NEXT(D.next);
+
+	not_equ:
+	regs[D.a] = regs[D.a] == 0xFF;
+	NEXT(D.next);
+
+	#undef RECORD
+	#undef D
+	#undef SYM
+	#undef NEXT
+	#undef NEXT_CHECKED
+	#undef NEXT_REG
+	#undef FLUSH
+	#undef STORE
+}
+
+
+// loads an image into a zeroed context, returns 0 or -1 after printing the parse errors
+int vm_load(vm_context *vm, const unsigned char *map, long long size)
+{
+	memset(vm, 0, sizeof(*vm));
+	int cs = load_image(map, size, vm->image);
+	if(cs < 0)
+	{
+		return -1;
+	}
+	vm->CS = cs;
+	vm->stack_top = stack_bound(vm->image, vm->CS);
+	return 0;
+}
+
+// same from a file, -1 also when the file cannot be mapped
+int vm_load_file(vm_context *vm, const char *path)
+{
+	int fd;
+	off_t size;
+	unsigned char *map = map_file(path, &size, &fd);
+	if(size < 0)
+	{
+		return -1;
+	}
+	int r = vm_load(vm, map, size);
+	unmap_file(map, fd, size);
+	return r;
+}
+
+// puts the loaded program back into RAM with fresh registers, ready for vm_run
+void vm_reset(vm_context *vm)
+{
+	memcpy(vm->RAM, vm->image, sizeof(vm->RAM));
+	memset(vm->reg_bank, 0, sizeof(vm->reg_bank));
+	vm->reg_bank[SP] = 8;
+	vm->reg_bank[PC] = vm->RAM[0];
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////    WIDE ADDRESS SPACE     ////////////////////
+//////////////////////////////////////////////////////////////
+
+// the same instruction set and image format on a machine with 16 or 32 bit registers and
+// addresses, for programs that do not fit next to a stack in 256 bytes. memory is made of
+// cells one register wide, so a saved PC or a pointer still takes one cell. the layout is
+// the 8 bit one turned around: function table at 0 .. 7, the code from 8 up, and the stack
+// from right above the code to the top of the address space. constants in the image are
+// still 8 bit, so a MOV of a constant into PC only reaches the first 256 cells
+//
+// memory is paged. a program is loaded once into pages that every run shares read only,
+// and a run gets a private page (a copy of the image page, or zeros) the first time it
+// stores into one. starting a run copies nothing and a deep stack only costs the pages it
+// touches. addresses go through a two level table: 12 bits of directory, 12 bits of table
+// and 8 bits of page. the 8 bit tiers (pre-decoding, native code, lanes, the cache) are
+// not available here, this is a plain step by step loop
+
+#define WIDE_PAGE_BITS	8
+#define WIDE_TABLE_BITS	12
+#define WIDE_PAGE		(1<<WIDE_PAGE_BITS)
+// private pages one run may hold, 64 MB of cells. a run past it ends in a RAM overflow
+#define WIDE_MAX_PAGES	(1<<16)
+// the most code the image format can describe, 8 functions of 31 five byte instructions
+#define WIDE_MAX_CODE	(8*31*5)
+
+typedef unsigned int vm_word;
+
+// a loaded program, never written once loaded
+typedef struct
+{
+	int bits;
+	// the function table and the code, padded to whole pages
+	vm_word *cells;
+	int pages;
+	// bottom of the stack, right above the code
+	vm_word SS;
+} vm_wide_image;
+
+typedef struct
+{
+	const vm_wide_image *image;
+	vm_word mask;
+	unsigned long long limit;
+	vm_word regs[8];
+	// private pages by directory and table index, NULL until stored into
+	vm_word **dir[1<<(32 - WIDE_TABLE_BITS - WIDE_PAGE_BITS)];
+	int pages;
+	// PRINT output, "STDOUT : n" lines on stdout when NULL
+	vm_output *out;
+} vm_wide;
+
+// returns 0, or -1 after printing the parse errors
+int wide_load(vm_wide_image *img, const unsigned char *map, long long size, int bits)
+{
+	unsigned char mem[8 + WIDE_MAX_CODE];
+	int table[8];
+	int cs = load_code(map, size, mem, sizeof(mem), table);
+	if(cs < 0)
+	{
+		return -1;
+	}
+
+	// moved down to 8, nothing in the code holds an absolute address but the table
+	int code = sizeof(mem) - cs;
+	img->bits = bits;
+	img->SS = 8 + code;
+	img->pages = (img->SS + WIDE_PAGE - 1) >> WIDE_PAGE_BITS;
+	img->cells = calloc((size_t)img->pages << WIDE_PAGE_BITS, sizeof(vm_word));
+	for(int j = 0; j<8; ++j)
+	{
+		img->cells[j] = table[j] ? table[j] - cs + 8 : 0;
+	}
+	for(int i = 0; i<code; ++i)
+	{
+		img->cells[8 + i] = mem[cs + i];
+	}
+	return 0;
+}
+
+// drops the private pages
+void wide_free(vm_wide *w)
+{
+	for(size_t d = 0; d<sizeof(w->dir)/sizeof(w->dir[0]); ++d)
+	{
+		if(w->dir[d])
+		{
+			for(int t = 0; t<(1<<WIDE_TABLE_BITS); ++t)
+			{
+				free(w->dir[d][t]);
+			}
+			free(w->dir[d]);
+			w->dir[d] = NULL;
+		}
+	}
+	w->pages = 0;
+}
+
+// back to the image with fresh registers, w zeroed or used before
+void wide_reset(vm_wide *w, const vm_wide_image *img)
+{
+	wide_free(w);
+	w->image = img;
+	w->mask = img->bits == 32 ? 0xFFFFFFFFu : (1u << img->bits) - 1;
+	w->limit = 1ULL << img->bits;
+	memset(w->regs, 0, sizeof(w->regs));
+	w->regs[SP] = img->SS;
+	w->regs[PC] = img->cells[0];
+}
+
+static inline vm_word wide_read(const vm_wide *w, vm_word a)
+{
+	vm_word **table = w->dir[a >> (WIDE_TABLE_BITS + WIDE_PAGE_BITS)];
+	vm_word *page = table ? table[(a >> WIDE_PAGE_BITS) & ((1<<WIDE_TABLE_BITS) - 1)] : NULL;
+	if(page)
+	{
+		return page[a & (WIDE_PAGE - 1)];
+	}
+	return (a >> WIDE_PAGE_BITS) < (vm_word)w->image->pages ? w->image->cells[a] : 0;
+}
+
+// the private page holding a, made on first use. NULL past WIDE_MAX_PAGES
+static vm_word *wide_page(vm_wide *w, vm_word a)
+{
+	vm_word ***table = &w->dir[a >> (WIDE_TABLE_BITS + WIDE_PAGE_BITS)];
+	if(!*table)
+	{
+		*table = calloc(1<<WIDE_TABLE_BITS, sizeof(vm_word *));
+	}
+	vm_word **page = &(*table)[(a >> WIDE_PAGE_BITS) & ((1<<WIDE_TABLE_BITS) - 1)];
+	if(!*page)
+	{
+		if(w->pages == WIDE_MAX_PAGES)
+		{
+			return NULL;
+		}
+		vm_word p = a >> WIDE_PAGE_BITS;
+		*page = malloc(WIDE_PAGE*sizeof(vm_word));
+		if(p < (vm_word)w->image->pages)
+		{
+			memcpy(*page, &w->image->cells[p << WIDE_PAGE_BITS], WIDE_PAGE*sizeof(vm_word));
+		}
+		else
+		{
+			memset(*page, 0, WIDE_PAGE*sizeof(vm_word));
+		}
+		w->pages++;
+	}
+	return *page;
+}
+
+// 0, or -2 when the page budget is used up
+static int wide_store(vm_wide *w, vm_word a, vm_word v)
+{
+	a &= w->mask;
+	vm_word *page = wide_page(w, a);
+	if(!page)
+	{
+		return -2;
+	}
+	page[a & (WIDE_PAGE - 1)] = v & w->mask;
+	return 0;
+}
+
+static vm_word wide_val(const vm_wide *w, vm_word kind, vm_word v)
+{
+	switch(kind)
+	{
+		case CNST:
+		return v;
+		case RGSTR:
+		return w->regs[v & 7];
+		case SYMBL:
+		return wide_read(w, (w->regs[SP] + v) & w->mask);
+		case PNTR:
+		return wide_read(w, wide_read(w, (w->regs[SP] + v) & w->mask));
+	}
+	return 0;
+}
+
+// runs the program like vm_step does on the 8 bit machine. returns 1 when main returns,
+// -1 on a stack overflow, -2 when it runs out of pages and 0 on anything undefined
+int wide_run(vm_wide *w)
+{
+	vm_word *regs = w->regs, mask = w->mask;
+	int err = 0;
+
+	for(;;)
+	{
+		if((unsigned long long)regs[SP] + regs[SZ] >= w->limit)
+		{
+			return -1;
+		}
+		vm_word pc = regs[PC];
+		vm_word op = wide_read(w, pc);
+		vm_word k1 = wide_read(w, (pc + 1) & mask), v1 = wide_read(w, (pc + 2) & mask);
+		vm_word k2 = wide_read(w, (pc + 3) & mask), v2 = wide_read(w, (pc + 4) & mask);
+
+		switch(op)
+		{
+			case MOV:
+			{
+				vm_word v = wide_val(w, k2, v2);
+				if(k1 == RGSTR)
+				{
+					regs[v1 & 7] = v;
+				}
+				else if(k1 == SYMBL)
+				{
+					err = wide_store(w, regs[SP] + v1, v);
+				}
+				else if(k1 == PNTR)
+				{
+					err = wide_store(w, wide_read(w, (regs[SP] + v1) & mask), v);
+				}
+				regs[PC] = (regs[PC] + 5) & mask;
+			}
+			break;
+
+			case CAL:
+			regs[PC] = (pc + 3) & mask;
+			err = wide_store(w, regs[SP] + regs[SZ], regs[SZ]);
+			err = err ? err : wide_store(w, regs[SP] + regs[SZ] + 1, regs[PC]);
+			regs[PC] = wide_read(w, v1 & mask);
+			regs[SP] = (regs[SP] + regs[SZ] + 2) & mask;
+			break;
+
+			case RET:
+			if(regs[SP] == w->image->SS)
+			{
+				return 1;
+			}
+			regs[SZ] = wide_read(w, (regs[SP] - 2) & mask);
+			regs[PC] = wide_read(w, (regs[SP] - 1) & mask);
+			regs[SP] = (regs[SP] - 2 - regs[SZ]) & mask;
+			break;
+
+			case REF:
+			err = wide_store(w, regs[SP] + v1, regs[SP] + v2);
+			regs[PC] = (pc + 5) & mask;
+			break;
+
+			case ADD:
+			regs[v1 & 7] = (regs[v1 & 7] + regs[v2 & 7]) & mask;
+			regs[PC] = (regs[PC] + 5) & mask;
+			break;
+
+			case PRINT:
+			if(w->out)
+			{
+				out_put(w->out, wide_val(w, k1, v1));
+			}
+			else
+			{
+				printf("STDOUT : %u\n", wide_val(w, k1, v1));
+			}
+			regs[PC] = (pc + 3) & mask;
+			break;
+
+			case NOT:
+			regs[v1 & 7] = ~regs[v1 & 7] & mask;
+			regs[PC] = (regs[PC] + 3) & mask;
+			break;
+
+			case EQU:
+			regs[v1 & 7] = !regs[v1 & 7];
+			regs[PC] = (regs[PC] + 3) & mask;
+			break;
+
+			default:
+			return 0;
+		}
+		if(err)
+		{
+			return err;
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////       IMAGE CACHE         ////////////////////
+//////////////////////////////////////////////////////////////
+
+// the loaded RAM layout (code, function table, operands already renamed to their final
+// symbol slots) and CS, saved next to the image so a repeat run skips the dump, the parse
+// and the checks. keyed by the size and FNV-1a hash of the image, and guarded by a
+// checksum of its own, so a stale, foreign or truncated file is just a miss
+
+#define CACHE_MAGIC		0x43524d56
+#define CACHE_VERSION	1
+#define FNV_OFFSET		0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+typedef struct
+{
+	unsigned int magic, version;
+	unsigned long long source_hash, source_size;
+	unsigned char CS, pad[7];
+	unsigned char image[1<<8];
+	// FNV-1a of everything above
+	unsigned long long checksum;
+} vm_cache_file;
+
+unsigned long long fnv1a(const unsigned char *p, size_t n, unsigned long long h)
+{
+	for(size_t i = 0; i<n; ++i)
+	{
+		h = (h ^ p[i])*FNV_PRIME;
+	}
+	return h;
+}
+
+// 0 and a loaded context on a hit, -1 on any kind of miss
+int cache_load(vm_context *vm, const char *path, unsigned long long hash, long long size)
+{
+	int fd;
+	off_t len;
+	const vm_cache_file *c = (const vm_cache_file *)map_file(path, &len, &fd);
+	if(len < 0)
+	{
+		return -1;
+	}
+	int hit = len == sizeof(vm_cache_file) && c->magic == CACHE_MAGIC && c->version == CACHE_VERSION
+		&& c->source_hash == hash && c->source_size == (unsigned long long)size
+		&& c->checksum == fnv1a((const unsigned char *)c, offsetof(vm_cache_file, checksum), FNV_OFFSET);
+	if(hit)
+	{
+		memset(vm, 0, sizeof(*vm));
+		memcpy(vm->image, c->image, sizeof(vm->image));
+		vm->CS = c->CS;
+		vm->stack_top = stack_bound(vm->image, vm->CS);
+	}
+	unmap_file((unsigned char *)c, fd, len);
+	return hit ? 0 : -1;
+}
+
+// written to a temporary file and renamed over path, so readers never see half a cache
+int cache_store(const vm_context *vm, const char *path, unsigned long long hash, long long size)
+{
+	vm_cache_file c;
+	memset(&c, 0, sizeof(c));
+	c.magic = CACHE_MAGIC;
+	c.version = CACHE_VERSION;
+	c.source_hash = hash;
+	c.source_size = size;
+	c.CS = vm->CS;
+	memcpy(c.image, vm->image, sizeof(c.image));
+	c.checksum = fnv1a((const unsigned char *)&c, offsetof(vm_cache_file, checksum), FNV_OFFSET);
+
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	FILE *f = fopen(tmp, "wb");
+	if(!f)
+	{
+		return 0;
+	}
+	int ok = fwrite(&c, sizeof(c), 1, f) == 1;
+	ok = !fclose(f) && ok;
+	if(!ok || rename(tmp, path))
+	{
+		remove(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////     LOCKSTEP LANES        ////////////////////
+//////////////////////////////////////////////////////////////
+
+// LANES copies of one loaded program stepping together, for running it over many
+// initial states. every RAM byte and register is a vector with one element per lane
+// (RAM[addr][lane]), so ADD, NOT, EQU and MOVs between registers and stack symbols are
+// single vector operations under a lane mask
+//
+// each step picks a leader (deepest stack, then lowest PC) and executes the instruction
+// at its PC for every lane at the same PC, SP and SZ, so stack accesses are uniform rows
+// and the others wait. lanes that split on a computed jump or a CAL/RET therefore run
+// under a mask until they meet again. pointer operands are gathered lane by lane
+//
+// code is shared, so a lane that stores into the code segment, runs code outside it, or
+// hits something only vm_step handles, leaves the group and finishes on the scalar VM
+
+#define LANES 32
+
+typedef unsigned char lane_vec __attribute__((vector_size(LANES)));
+
+#define SPLAT(x) ((lane_vec){0} + (unsigned char)(x))
+#define SELECT(m, a, b) (((m) & (a)) | (~(m) & (b)))
+
+typedef struct
+{
+	lane_vec RAM[1<<8];
+	lane_vec reg_bank[8];
+	// 0xFF while the lane runs
+	lane_vec active;
+	// exit code per lane, as vm_run would return it
+	int status[LANES];
+	unsigned char CS;
+	// the loaded program, for the lanes that finish on the scalar VM
+	const vm_context *program;
+
+	// PRINT output, with the lane that printed
+	void (*print)(void *user, int lane, unsigned char value);
+	void *user;
+} vm_lanes;
+
+typedef struct
+{
+	vm_lanes *v;
+	int lane;
+} lane_ref;
+
+void lane_print(void *user, unsigned char value)
+{
+	lane_ref *r = user;
+	r->v->print(r->v->user, r->lane, value);
+}
+
+// every lane starts as the program right after vm_reset, set per lane registers afterwards
+void lanes_init(vm_lanes *v, const vm_context *program, int count)
+{
+	for(int a = 0; a<(1<<8); ++a)
+	{
+		v->RAM[a] = SPLAT(program->image[a]);
+	}
+	for(int r = 0; r<8; ++r)
+	{
+		v->reg_bank[r] = SPLAT(0);
+	}
+	v->reg_bank[SP] = SPLAT(8);
+	v->reg_bank[PC] = SPLAT(program->image[0]);
+	v->CS = program->CS;
+	v->program = program;
+	for(int l = 0; l<LANES; ++l)
+	{
+		v->active[l] = l < count ? 0xFF : 0;
+		v->status[l] = 0;
+	}
+}
+
+// moves lane l into a scalar context and runs it to the end from where it stands. the
+// image comes along since vm_step reads register operands past reg_bank out of the fields
+// after it, and the stack is left unbounded as the lane may already have moved SP or SZ
+void lane_finish_scalar(vm_lanes *v, int l)
+{
+	vm_context *vm = malloc(sizeof(vm_context));
+	lane_ref ref = {v, l};
+
+	memset(vm, 0, sizeof(*vm));
+	memcpy(vm->image, v->program->image, sizeof(vm->image));
+	vm->stack_top = 0;
+	for(int a = 0; a<(1<<8); ++a)
+	{
+		vm->RAM[a] = v->RAM[a][l];
+	}
+	for(int r = 0; r<8; ++r)
+	{
+		vm->reg_bank[r] = v->reg_bank[r][l];
+	}
+	vm->CS = v->CS;
+	vm->print = lane_print;
+	vm->user = &ref;
+
+	v->status[l] = vm_run(vm);
+	v->active[l] = 0;
+	free(vm);
+}
+
+// lanes in m stop with the given exit code
+void lanes_exit(vm_lanes *v, const lane_vec *m, int status)
+{
+	for(int l = 0; l<LANES; ++l)
+	{
+		if((*m)[l])
+		{
+			v->status[l] = status;
+		}
+	}
+	v->active &= ~*m;
+}
+
+// runs until every lane has finished, results are in status
+void lanes_run(vm_lanes *v)
+{
+	// decoded instructions are shared by all lanes, code never changes under them
+	struct { signed char h; unsigned char a, b, src, next; } code[1<<8];
+	for(int i = 0; i<(1<<8); ++i)
+	{
+		code[i].h = -1;
+	}
+
+	lane_vec *RAM = v->RAM, *regs = v->reg_bank;
+	unsigned char CS = v->CS;
+
+	// the group running straight line code stays the same, so the leader is only picked
+	// again after control flow, a write to SP or SZ, or a lane leaving (lead = -1)
+	int lead = -1;
+	lane_vec m = SPLAT(0);
+
+	while(1)
+	{
+		if(lead < 0)
+		{
+			for(int l = 0; l<LANES; ++l)
+			{
+				if(v->active[l] && (lead < 0 || regs[SP][l] > regs[SP][lead]
+					|| (regs[SP][l] == regs[SP][lead] && regs[PC][l] < regs[PC][lead])))
+				{
+					lead = l;
+				}
+			}
+			if(lead < 0)
+			{
+				return;
+			}
+			m = v->active & (lane_vec)(regs[PC] == SPLAT(regs[PC][lead]))
+				& (lane_vec)(regs[SP] == SPLAT(regs[SP][lead])) & (lane_vec)(regs[SZ] == SPLAT(regs[SZ][lead]));
+		}
+
+		unsigned char pc = regs[PC][lead], sp = regs[SP][lead], sz = regs[SZ][lead];
+
+		if(sp + sz >= CS)
+		{
+			lanes_exit(v, &m, -1);
+			lead = -1;
+			continue;
+		}
+
+		if(code[pc].h < 0)
+		{
+			// the code segment is the same in every lane still running
+			unsigned char column[1<<8];
+			for(int k = 0; k<5; ++k)
+			{
+				column[(unsigned char)(pc + k)] = RAM[(unsigned char)(pc + k)][lead];
+			}
+			int len, h = decode_insn(column, pc, &code[pc].a, &code[pc].b, &code[pc].src, &len);
+			code[pc].h = (pc < CS || pc + len > (1<<8)) ? H_SLOW : h;
+			code[pc].next = pc + len;
+		}
+		unsigned char a = code[pc].a, b = code[pc].b, next = code[pc].next;
+		// lanes whose store landed in the code segment
+		lane_vec leave = SPLAT(0);
+		lane_vec src;
+
+		#define SYMROW(k) RAM[(unsigned char)(sp + (k))]
+		#define GATHER(out, k) for(int l = 0; l<LANES; ++l) out[l] = RAM[SYMROW(k)[l]][l]
+		#define STOREROW(addr, val) do { unsigned char at_ = (addr); RAM[at_] = SELECT(m, (val), RAM[at_]); \
+			if(at_ >= CS) leave |= m; } while(0)
+		#define SCATTER(k, val) for(int l = 0; l<LANES; ++l) if(m[l]) { unsigned char at_ = SYMROW(k)[l]; \
+			RAM[at_][l] = (val)[l]; if(at_ >= CS) leave[l] = 0xFF; }
+
+		switch(code[pc].h)
+		{
+			case H_NOP:
+			break;
+
+			case H_MOV_RC: case H_MOV_SC: case H_MOV_PC:
+			case H_MOV_RR: case H_MOV_SR: case H_MOV_PR:
+			case H_MOV_RS: case H_MOV_SS: case H_MOV_PS:
+			case H_MOV_RP: case H_MOV_SP: case H_MOV_PP:
+			{
+				int h = code[pc].h - H_MOV_RC;
+				switch(h & 3)
+				{
+					case CNST: src = SPLAT(b); break;
+					case RGSTR: src = regs[b]; break;
+					case SYMBL: src = SYMROW(b); break;
+					default: GATHER(src, b); break;
+				}
+				switch(h >> 2)
+				{
+					case 0: regs[a] = SELECT(m, src, regs[a]); lead = a < SP ? lead : -1; break;
+					case 1: STOREROW(sp + a, src); break;
+					default: SCATTER(a, src); break;
+				}
+				break;
+			}
+
+			case H_JMP:
+			switch(code[pc].src)
+			{
+				case CNST: src = SPLAT(b); break;
+				case RGSTR: src = regs[b]; break;
+				case SYMBL: src = SYMROW(b); break;
+				default: GATHER(src, b); break;
+			}
+			regs[PC] = SELECT(m, src + 5, regs[PC]);
+			lead = -1;
+			continue;
+
+			case H_CAL:
+			STOREROW(sp + sz, SPLAT(sz));
+			STOREROW(sp + sz + 1, SPLAT(next));
+			regs[SP] = SELECT(m, SPLAT(sp + sz + 2), regs[SP]);
+			regs[PC] = SELECT(m, RAM[a], regs[PC]);
+			lead = -1;
+			break;
+
+			case H_RET:
+			lead = -1;
+			if(sp == 8)
+			{
+				lanes_exit(v, &m, 1);
+				continue;
+			}
+			{
+				lane_vec nsz = RAM[(unsigned char)(sp - 2)];
+				regs[PC] = SELECT(m, RAM[(unsigned char)(sp - 1)], regs[PC]);
+				regs[SZ] = SELECT(m, nsz, regs[SZ]);
+				regs[SP] = SELECT(m, SPLAT(sp - 2) - nsz, regs[SP]);
+			}
+			continue;
+
+			case H_REF:
+			STOREROW(sp + a, SPLAT(sp + b));
+			break;
+
+			case H_ADD:
+			regs[a] = SELECT(m, regs[a] + regs[b], regs[a]);
+			lead = a < SP ? lead : -1;
+			break;
+
+			case H_ADD_PC:
+			regs[PC] = SELECT(m, SPLAT(pc + 5) + regs[b], regs[PC]);
+			lead = -1;
+			continue;
+
+			case H_PRINT_C: case H_PRINT_R: case H_PRINT_S: case H_PRINT_P:
+			switch(code[pc].h - H_PRINT_C)
+			{
+				case CNST: src = SPLAT(a); break;
+				case RGSTR: src = regs[a]; break;
+				case SYMBL: src = SYMROW(a); break;
+				default: GATHER(src, a); break;
+			}
+			for(int l = 0; l<LANES; ++l)
+			{
+				if(m[l])
+				{
+					v->print(v->user, l, src[l]);
+				}
+			}
+			break;
+
+			case H_NOT:
+			regs[a] = SELECT(m, ~regs[a], regs[a]);
+			lead = a < SP ? lead : -1;
+			break;
+
+			case H_EQU:
+			regs[a] = SELECT(m, (lane_vec)(regs[a] == SPLAT(0)) & SPLAT(1), regs[a]);
+			lead = a < SP ? lead : -1;
+			break;
+
+			default:
+			// H_SLOW, H_BAD and anything outside the code segment
+			for(int l = 0; l<LANES; ++l)
+			{
+				if(m[l])
+				{
+					lane_finish_scalar(v, l);
+				}
+			}
+			lead = -1;
+			continue;
+		}
+
+		// CAL has already set PC
+		if(code[pc].h != H_CAL)
+		{
+			regs[PC] = SELECT(m, SPLAT(next), regs[PC]);
+		}
+		for(int l = 0; l<LANES; ++l)
+		{
+			if(leave[l])
+			{
+				lane_finish_scalar(v, l);
+				lead = -1;
+			}
+		}
+
+		#undef SYMROW
+		#undef GATHER
+		#undef STOREROW
+		#undef SCATTER
+	}
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////       BATCH RUNNER        ////////////////////
+//////////////////////////////////////////////////////////////
+
+// runs a list of jobs on a pool of threads. a job is either an image to load and run, or
+// initial values for the general purpose registers of one shared, already loaded program.
+// workers take jobs off a shared counter and own everything they write to: their context,
+// their output arena and the result fields of the jobs they took. with lanes set, shared
+// program jobs are taken LANES at a time and run in lockstep
+
+typedef struct
+{
+	unsigned char *data;
+	size_t len, cap;
+} vm_arena;
+
+typedef struct
+{
+	// image to load, NULL to run the shared program
+	const char *path;
+	// initial r0 .. r4
+	unsigned char regs[5];
+
+	// exit code as returned by vm_run, -3 if the image did not load
+	int status;
+	// printed values, out_len bytes at out_off in the arena of worker out_arena
+	int out_arena;
+	size_t out_off, out_len;
+} vm_job;
+
+typedef struct
+{
+	vm_job *jobs;
+	int count;
+	int next;
+	const vm_context *program;
+	vm_arena *arenas;
+	int lanes;
+} vm_batch;
+
+typedef struct
+{
+	vm_batch *batch;
+	int id;
+} vm_worker;
+
+void arena_push(void *user, unsigned char value)
+{
+	vm_arena *a = user;
+	if(a->len == a->cap)
+	{
+		a->cap = a->cap ? 2*a->cap : 4096;
+		a->data = realloc(a->data, a->cap);
+	}
+	a->data[a->len++] = value;
+}
+
+void lane_push(void *user, int lane, unsigned char value)
+{
+	arena_push((vm_arena *)user + lane, value);
+}
+
+void lanes_worker(vm_worker *w)
+{
+	vm_batch *b = w->batch;
+	vm_arena *arena = &b->arenas[w->id];
+	vm_lanes *v = malloc(sizeof(vm_lanes));
+	vm_arena out[LANES] = {{0}};
+
+	v->print = lane_push;
+	v->user = out;
+	for(int i = __atomic_fetch_add(&b->next, LANES, __ATOMIC_RELAXED); i < b->count; i = __atomic_fetch_add(&b->next, LANES, __ATOMIC_RELAXED))
+	{
+		int n = b->count - i < LANES ? b->count - i : LANES;
+		lanes_init(v, b->program, n);
+		for(int l = 0; l<n; ++l)
+		{
+			for(int r = 0; r<5; ++r)
+			{
+				v->reg_bank[r][l] = b->jobs[i + l].regs[r];
+			}
+			out[l].len = 0;
+		}
+		lanes_run(v);
+
+		for(int l = 0; l<n; ++l)
+		{
+			vm_job *job = &b->jobs[i + l];
+			job->status = v->status[l];
+			job->out_arena = w->id;
+			job->out_off = arena->len;
+			job->out_len = out[l].len;
+			for(size_t k = 0; k<out[l].len; ++k)
+			{
+				arena_push(arena, out[l].data[k]);
+			}
+		}
+	}
+	for(int l = 0; l<LANES; ++l)
+	{
+		free(out[l].data);
+	}
+	free(v);
+}
+
+void *batch_worker(void *arg)
+{
+	vm_worker *w = arg;
+	vm_batch *b = w->batch;
+	vm_arena *arena = &b->arenas[w->id];
+
+	if(b->lanes)
+	{
+		lanes_worker(w);
+		return NULL;
+	}
+
+	vm_context *vm = malloc(sizeof(vm_context));
+	// native code is per thread, shared program jobs reuse it from one run to the next
+	vm_jit *jit = b->program && b->program->jit ? jit_create() : NULL;
+
+	for(int i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED); i < b->count; i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED))
+	{
+		vm_job *job = &b->jobs[i];
+		job->out_arena = w->id;
+		job->out_off = arena->len;
+		job->out_len = 0;
+
+		if(job->path)
+		{
+			if(vm_load_file(vm, job->path) < 0)
+			{
+				job->status = -3;
+				continue;
+			}
+		}
+		else
+		{
+			memcpy(vm, b->program, sizeof(vm_context));
+		}
+		vm->trace = NULL;
+		vm->print = arena_push;
+		vm->user = arena;
+		vm->jit = job->path ? NULL : jit;
+		if(jit && jit->smc)
+		{
+			jit_flush(jit);
+		}
+
+		vm_reset(vm);
+		memcpy(vm->reg_bank, job->regs, sizeof(job->regs));
+		job->status = vm_run(vm);
+		job->out_len = arena->len - job->out_off;
+	}
+	jit_destroy(jit);
+	free(vm);
+	return NULL;
+}
+
+// runs every job, program is only needed for jobs without a path. lanes needs every job
+// to be without a path
+void vm_run_batch(vm_job *jobs, int count, const vm_context *program, int threads, int lanes)
+{
+	vm_batch b = {jobs, count, 0, program, calloc(threads, sizeof(vm_arena)), lanes};
+	vm_worker *workers = malloc(threads*sizeof(vm_worker));
+	pthread_t *pool = malloc(threads*sizeof(pthread_t));
+
+	for(int t = 0; t<threads; ++t)
+	{
+		workers[t].batch = &b;
+		workers[t].id = t;
+		pthread_create(&pool[t], NULL, batch_worker, &workers[t]);
+	}
+	for(int t = 0; t<threads; ++t)
+	{
+		pthread_join(pool[t], NULL);
+	}
+
+	// report in job order
+	for(int i = 0; i<count; ++i)
+	{
+		vm_job *job = &jobs[i];
+		if(job->path)
+		{
+			printf("%s :", job->path);
+		}
+		else
+		{
+			printf("%d (%d %d %d %d %d) :", i, job->regs[0], job->regs[1], job->regs[2], job->regs[3], job->regs[4]);
+		}
+		if(job->status == -3)
+		{
+			printf(" failed to load\n");
+			continue;
+		}
+		printf(" exit %d (%s)", job->status, exit_codes[job->status + 2]);
+		const unsigned char *out = b.arenas[job->out_arena].data + job->out_off;
+		for(size_t k = 0; k<job->out_len; ++k)
+		{
+			printf(" %d", out[k]);
+		}
+		printf("\n");
+	}
+
+	for(int t = 0; t<threads; ++t)
+	{
+		free(b.arenas[t].data);
+	}
+	free(b.arenas);
+	free(workers);
+	free(pool);
+}
+
+
+// trace file: magic, version, number of instructions executed (u64), the RAM image the
+// run started from, then the records still in the ring, oldest first
+int write_trace(const char *path, const vm_trace *trace, const unsigned char *image)
+{
+	FILE *f = fopen(path, "wb");
+	if(!f)
+	{
+		return 0;
+	}
+	unsigned int header[2] = {TRACE_MAGIC, TRACE_VERSION};
+	unsigned long long first = trace->head > TRACE_RING ? trace->head - TRACE_RING : 0;
+
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(&trace->head, sizeof(trace->head), 1, f);
+	fwrite(image, 1, 1<<8, f);
+	for(unsigned long long i = first; i<trace->head; ++i)
+	{
+		fwrite(&trace->ring[i % TRACE_RING], sizeof(unsigned int), 1, f);
+	}
+	return fclose(f) == 0;
+}
+
+// prints a trace file written by write_trace, operands come from the saved image
+int decode_trace(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+	{
+		printf("Error opening trace %s\n", path);
+		return 0;
+	}
+
+	unsigned int header[2];
+	unsigned long long total;
+	unsigned char image[1<<8];
+	if(fread(header, sizeof(header), 1, f) != 1 || header[0] != TRACE_MAGIC || header[1] != TRACE_VERSION
+		|| fread(&total, sizeof(total), 1, f) != 1 || fread(image, 1, 1<<8, f) != 1<<8)
+	{
+		printf("%s is not a trace file\n", path);
+		fclose(f);
+		return 0;
+	}
+
+	unsigned long long seq = total > TRACE_RING ? total - TRACE_RING : 0;
+	unsigned int rec;
+	printf("%llu instructions executed, showing the last %llu\n", total, total - seq);
+	while(fread(&rec, sizeof(rec), 1, f) == 1)
+	{
+		unsigned char pc = rec, op = rec >> 8, sp = rec >> 16, sz = rec >> 24;
+		printf("%10llu  %3d  SP %3d SZ %3d ", seq++, pc, sp, sz);
+		print_instruction(op);
+		switch(op)
+		{
+			case MOV:
+			case REF:
+			case ADD:
+			print_args(image[(pc+1) & 0xFF], image[(pc+2) & 0xFF]);
+			print_args(image[(pc+3) & 0xFF], image[(pc+4) & 0xFF]);
+			break;
+
+			case CAL:
+			case PRINT:
+			case NOT:
+			case EQU:
+			print_args(image[(pc+1) & 0xFF], image[(pc+2) & 0xFF]);
+			break;
+		}
+		printf("\n");
+	}
+	fclose(f);
+	return 1;
+}
+
+
+#ifndef EMU_NO_MAIN
+
+int main(int argc, char const *argv[])
+{
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    ////////////////  READING FILE AND LOADING CONTENTS INTO MEMORY  ///////////////////////
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+
+	if(argc == 1)
+	{
+		printf("No arguments provided\n");
+		return -1;
+	}
+
+	if(!strcmp(argv[1], "--decode-trace"))
+	{
+		return argc > 2 && decode_trace(argv[2]) ? 0 : -1;
+	}
+
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(!strcmp(argv[1], "--batch"))
+	{
+		vm_job *jobs = calloc(argc, sizeof(vm_job));
+		int count = 0;
+		for(int i = 2; i<argc; ++i)
+		{
+			if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+			{
+				threads = atoi(argv[++i]);
+			}
+			else
+			{
+				jobs[count++].path = argv[i];
+			}
+		}
+		vm_run_batch(jobs, count, NULL, threads < 1 ? 1 : threads, 0);
+		free(jobs);
+		return 0;
+	}
+
+	vm_trace trace = {TRACE_OFF, 0, NULL, NULL};
+	const char *trace_path = "vm_trace.bin";
+	int profile = PROF_OFF;
+	const char *profile_path = "vm_profile.folded";
+	const char *inputs_path = NULL;
+	int show_disasm = 0;
+	int lanes = 0;
+	int use_jit = 0;
+	int optimize = 0;
+	int addr_bits = 8;
+	int use_cache = 1;
+	int unbuffered = 0;
+	const char *cache_path = NULL;
+	for(int i = 2; i<argc; ++i)
+	{
+		if(!strcmp(argv[i], "--disasm"))
+		{
+			show_disasm = 1;
+		}
+		else if(!strcmp(argv[i], "--inputs") && i + 1 < argc)
+		{
+			inputs_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--threads") && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--lanes"))
+		{
+			lanes = 1;
+		}
+		else if(!strcmp(argv[i], "--jit"))
+		{
+			use_jit = 1;
+		}
+		else if(!strcmp(argv[i], "--optimize"))
+		{
+			optimize = 1;
+		}
+		else if(!strcmp(argv[i], "--addr-bits") && i + 1 < argc)
+		{
+			addr_bits = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--no-cache"))
+		{
+			use_cache = 0;
+		}
+		else if(!strcmp(argv[i], "--unbuffered"))
+		{
+			unbuffered = 1;
+		}
+		else if(!strcmp(argv[i], "--cache") && i + 1 < argc)
+		{
+			cache_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--trace") && i + 1 < argc)
+		{
+			++i;
+			trace.level = !strcmp(argv[i], "insn") ? TRACE_INSN : !strcmp(argv[i], "summary") ? TRACE_SUMMARY : TRACE_OFF;
+		}
+		else if(!strcmp(argv[i], "--trace-file") && i + 1 < argc)
+		{
+			trace_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--profile") && i + 1 < argc)
+		{
+			++i;
+			profile = !strcmp(argv[i], "count") ? PROF_COUNT : !strcmp(argv[i], "sample") ? PROF_SAMPLE : PROF_OFF;
+		}
+		else if(!strcmp(argv[i], "--profile-file") && i + 1 < argc)
+		{
+			profile_path = argv[++i];
+		}
+	}
+
+	const char *address = argv[1];
+	int fd;
+	off_t res;
+	unsigned char *map = map_file(address, &res, &fd);
+
+	switch(res)
+	{
+		case -1:
+		printf("Error opening file\n");
+		break;
+		case -2:
+		printf("Error getting file size\n");
+		break;
+		case -3:
+		printf("Empty file\n");
+		break;
+		case -4:
+		printf("Error creating mapping\n");
+		break;
+		default:
+		break;
+	}
+	if(res < 0)
+	{
+		return -1;
+	}
+
+    // the wide machine has its own loader and loop, and none of the options below
+    if(addr_bits != 8)
+    {
+    	if(addr_bits != 16 && addr_bits != 32)
+    	{
+    		printf("Address width must be 8, 16 or 32 bits\n");
+    		return -1;
+    	}
+    	vm_wide_image image;
+    	printf("Loading parsed instructions into %d bit virtual memory...\n", addr_bits);
+    	int loaded = wide_load(&image, map, res, addr_bits);
+    	unmap_file(map, fd, res);
+    	if(loaded < 0)
+    	{
+    		printf("Fatal errors occured during parse. Check log messages for more info.\n");
+    		return -1;
+    	}
+    	printf("Code at 8 .. %u, stack from %u\n", image.SS - 1, image.SS);
+
+    	printf("\nInitializing virtual environment...\n");
+    	vm_wide *w = calloc(1, sizeof(vm_wide));
+    	wide_reset(w, &image);
+    	printf("Virtual machine running\n\n");
+    	vm_output *out = unbuffered ? NULL : malloc(sizeof(vm_output));
+    	fflush(stdout);
+    	if(out && out_open(out, STDOUT_FILENO) < 0)
+    	{
+    		free(out);
+    		out = NULL;
+    	}
+    	w->out = out;
+    	int terminated = wide_run(w);
+    	if(out)
+    	{
+    		out_close(out);
+    		free(out);
+    	}
+    	printf("\nVirtual machine terminated. Exit code : %d (%s)\n", terminated, exit_codes[terminated+2]);
+    	printf("%d private pages of %d cells\n", w->pages, WIDE_PAGE);
+    	wide_free(w);
+    	free(w);
+    	free(image.cells);
+    	return 0;
+    }
+
+    vm_context vm;
+    unsigned long long hash = fnv1a(map, res, FNV_OFFSET);
+    char default_cache[4096];
+    if(!cache_path)
+    {
+    	snprintf(default_cache, sizeof(default_cache), "%s.vmc", address);
+    	cache_path = default_cache;
+    }
+
+    // a cache hit skips the dump and the parse
+    if(use_cache && cache_load(&vm, cache_path, hash, res) == 0)
+    {
+    	unmap_file(map, fd, res);
+    	printf("Loaded %s from cache %s\n", address, cache_path);
+    }
+    else
+    {
+		//////////////////////////////////////////////////////////////////////////////////
+	    ///////////////          DISPLAYING THE MACHINE CODE          ////////////////////
+	    //////////////////////////////////////////////////////////////////////////////////
+
+		printf("\nMachine code at %s :\n", address);
+	    for(int i = 0; i<res; ++i)
+	    {
+	    	print_byte(map[i]);
+	    }
+
+	    printf("\n\n");
+	    
+
+	    ////////////////////////////////////////////////////////////////////////////////////////////////
+	    ///////////////   PARSING THE ASSEMBLY CODE AND LOADING IT TO VIRTUAL RAM   ////////////////////
+	    ////////////////////////////////////////////////////////////////////////////////////////////////
+
+		printf("Loading parsed instructions into virtual RAM...\n");
+	    
+	    int loaded = vm_load(&vm, map, res);
+		unmap_file(map, fd, res);
+
+	    if(loaded < 0)
+	    {
+	    	printf("Fatal errors occured during parse. Check log messages for more info.\n");
+	    	return -1;
+	    }
+
+	    if(use_cache && !cache_store(&vm, cache_path, hash, res))
+	    {
+	    	printf("Could not write cache %s\n", cache_path);
+	    }
+    }
+
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    /////////////// OPTIMIZING THE MACHINE CODE TO USE LESS STACK SPACE /////////////////////////
     /////////////////////////////////////////////////////////////////////////////////////////////
 
-    printf("\nInitializing virtual environment...\n");
+    // after the cache, which keeps the image as loaded
+    if(optimize)
+    {
+    	opt_stats st;
+    	if(optimize_image(&vm, &st) == 0)
+    	{
+    		printf("Optimized : %d sources forwarded, %d ADDs folded, %d dead stores dropped, stack %d -> %d bytes\n",
+    			st.forwarded, st.folded, st.dropped, st.stack_before, st.stack_after);
+    	}
+    	else
+    	{
+    		printf("Not optimized : needs a bounded stack and pointers set by REF\n");
+    	}
+    }
 
-    // initializing registers
-    // 0x07 : instruction pointer
-    // 0x06 : current stack size
-    // 0x05 : current stack pointer
-    unsigned char reg_bank[8] = {0, 0, 0, 0, 0, SS, 0, RAM[0]};
-    curr_op = 0;
-    arg1 = 0;
-    arg2 = 0;
-    arg1v = 0;
-    arg2v = 0;
+    if(use_jit)
+    {
+    	vm.jit = jit_create();
+    	if(!vm.jit)
+    	{
+    		printf("Native tier not available, interpreting\n");
+    	}
+    }
 
-    printf("Virtual machine running\n\n");
+    if(show_disasm)
+    {
+    	printf("Disassembled code:\n");
+    	disassemble(vm.image);
+    	if(vm.stack_top)
+    	{
+    		printf("Stack bounded : reaches %d at most, below CS at %d, no overflow checks\n", vm.stack_top, vm.CS);
+    	}
+    	else
+    	{
+    		printf("Stack not bounded : overflow checked after CAL, RET and SP / SZ writes\n");
+    	}
+    }
 
-    int terminated = 0;
-    while(!terminated)
+    // one run per line of initial register values
+    if(inputs_path)
     {
-    	curr_op = RAM[reg_bank[PC]];
-    	if(reg_bank[SP] + reg_bank[SZ] >= CS)
+    	FILE *f = fopen(inputs_path, "r");
+    	if(!f)
     	{
-    		terminated = -1;
-    		break;
+    		printf("Error opening %s\n", inputs_path);
+    		return -1;
     	}
-    	switch(curr_op)
+    	int count = 0, cap = 1024;
+    	vm_job *jobs = calloc(cap, sizeof(vm_job));
+    	char line[256];
+    	while(fgets(line, sizeof(line), f))
     	{
-    		case MOV:
-    		printf("MOVING\n");
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		arg2 = RAM[reg_bank[PC]+3];
-    		arg2v = RAM[reg_bank[PC]+4];
-    		write_val(RAM, reg_bank[SP], reg_bank, arg1, arg1v, read_val(RAM, reg_bank[SP], reg_bank, arg2, arg2v));
-    		reg_bank[PC] += 5;
-    		break;
-
-    		case CAL:
-    		printf("CALLING\n");
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		reg_bank[PC] += 3;
-    		RAM[reg_bank[SP] + reg_bank[SZ]] = reg_bank[SZ];
-    		RAM[reg_bank[SP] + reg_bank[SZ] + 1] = reg_bank[PC];
-    		reg_bank[PC] = RAM[arg1v];
-    		reg_bank[SP] += reg_bank[SZ] + 2;
-    		break;
-
-    		case RET:
-    		printf("RETURNING\n");
-    		if(reg_bank[SP] == 8)
+    		if(count == cap)
     		{
-    			terminated = 1;
-    			break;
+    			cap *= 2;
+    			jobs = realloc(jobs, cap*sizeof(vm_job));
     		}
-    		reg_bank[SZ] = RAM[reg_bank[SP] - 2];
-    		reg_bank[PC] = RAM[reg_bank[SP] - 1];
-    		reg_bank[SP] = reg_bank[SP] - 2 - RAM[reg_bank[SP] - 2];
-    		break;
-
-    		case REF:
-    		printf("CREATING REFERENCE\n");
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		arg2 = RAM[reg_bank[PC]+3];
-    		arg2v = RAM[reg_bank[PC]+4];
-    		RAM[reg_bank[SP] + arg1v] = reg_bank[SP] + arg2v;
-    		reg_bank[PC] += 5;
-    		break;
-
-    		case ADD:
-    		printf("ADDING\n");
-			arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		arg2 = RAM[reg_bank[PC]+3];
-    		arg2v = RAM[reg_bank[PC]+4];
-    		reg_bank[arg1v] += reg_bank[arg2v];
-    		printf("RESULT : %d\n", reg_bank[arg1v]);
-    		reg_bank[PC] += 5;
-    		break;
-
-    		case PRINT:
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		printf("STDOUT : %d\n", read_val(RAM, reg_bank[SP], reg_bank, arg1, arg1v));
-    		break;
-
-    		case NOT:
-    		printf("NEGATING\n");
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		reg_bank[arg1v] = ~reg_bank[arg1v];
-    		reg_bank[PC] += 3;
-    		break;
-
-    		case EQU:
-    		printf("COMPARING NULLITY\n");
-    		arg1 = RAM[reg_bank[PC]+1];
-    		arg1v = RAM[reg_bank[PC]+2];
-    		reg_bank[arg1v] = !reg_bank[arg1v];
-    		reg_bank[PC] += 3;
-    		break;
-
+    		memset(&jobs[count], 0, sizeof(vm_job));
+    		char *p = line, *end;
+    		for(int r = 0; r<5; ++r, p = end)
+    		{
+    			jobs[count].regs[r] = strtol(p, &end, 0);
+    			if(end == p)
+    			{
+    				break;
+    			}
+    		}
+    		count++;
     	}
+    	fclose(f);
+    	vm_run_batch(jobs, count, &vm, threads < 1 ? 1 : threads, lanes);
+    	free(jobs);
+    	jit_destroy(vm.jit);
+    	return 0;
+    }
+
+
+    /////////////////////////////////////////////////////////////////////////////////////////////
+    ///////////////    RUNNING THE MACHINE CODE ON A VIRTUAL MACHINE    /////////////////////////
+    /////////////////////////////////////////////////////////////////////////////////////////////
+
+    printf("\nInitializing virtual environment...\n");
+
+    vm_reset(&vm);
+    vm.trace = &trace;
+    if(trace.level == TRACE_INSN)
+    {
+    	trace.ring = malloc(sizeof(unsigned int)*TRACE_RING);
+    }
+    if(profile != PROF_OFF)
+    {
+    	trace.prof = malloc(sizeof(vm_profile));
+    	prof_init(trace.prof, profile);
+    }
+
+    printf("Virtual machine running\n\n");
+
+    // STDOUT lines go through the writer thread, everything else stays on stdio
+    vm_output *out = unbuffered ? NULL : malloc(sizeof(vm_output));
+    fflush(stdout);
+    if(out && out_open(out, STDOUT_FILENO) < 0)
+    {
+    	free(out);
+    	out = NULL;
+    }
+    if(out)
+    {
+    	vm.print = out_print;
+    	vm.user = out;
+    }
+
+    struct timespec t0, t1;
+    if(profile == PROF_SAMPLE)
+    {
+    	prof_timer(trace.prof);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int terminated = vm_run(&vm);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if(profile == PROF_SAMPLE)
+    {
+    	prof_timer(NULL);
+    }
+    if(out)
+    {
+    	out_close(out);
+    	free(out);
     }
     printf("\nVirtual machine terminated. Exit code : %d (%s)\n", terminated, exit_codes[terminated+2]);
 
+    if(trace.level != TRACE_OFF || trace.prof)
+    {
+    	double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)*1e-9;
+    	printf("Executed %llu instructions in %.6f s (%.0f instructions/s)\n", trace.head, secs, secs > 0 ? trace.head/secs : 0);
+    }
+    if(trace.ring)
+    {
+    	if(write_trace(trace_path, &trace, vm.image))
+    	{
+    		printf("Instruction trace written to %s\n", trace_path);
+    	}
+    	else
+    	{
+    		printf("Error writing trace to %s\n", trace_path);
+    	}
+    	free(trace.ring);
+    }
+    if(trace.prof)
+    {
+    	prof_finish(trace.prof, trace.head);
+    	if(prof_report(trace.prof, vm.RAM, profile_path))
+    	{
+    		printf("Flame graph stacks written to %s\n", profile_path);
+    	}
+    	else
+    	{
+    		printf("Error writing profile to %s\n", profile_path);
+    	}
+    	free(trace.prof);
+    }
+    jit_destroy(vm.jit);
+
 	return 0;
 }
+
+#endif
@@ -0,0 +1,653 @@
+// text assembler for emulator_001.c
+// turns the mnemonic syntax the disassembler prints into the reversed bit stream that
+// load_code reads, so programs can be written and generated instead of packed by hand
+//
+//   FUNC n [at addr]           starts function n (0 .. 7), 0 is the entry point. the "at"
+//                              part is ignored, so --disasm listings assemble back
+//   name:                      labels the next instruction
+//   OP [operand[, operand]]    MOV CAL RET REF ADD PRINT NOT EQU
+//
+// operands, as --disasm prints them or in short form :
+//   CNST n      n       constant 0 .. 255, decimal or 0x hex, -128 .. -1 wrap around
+//   RGSTR n     rn      register 0 .. 7, r5 SP, r6 SZ, r7 PC
+//   SYMBL X     X       stack symbol A .. g (no I)
+//   PNTR [X]    [X]     the cell symbol X points to
+//               @name   constant that makes MOV r7, @name continue at name
+//
+// ; and # start comments. functions go into RAM in source order, from the top down on the
+// 8 bit machine and from 8 up on the wide one, which is all @name depends on. an image
+// with no @name runs on both
+//
+//   --gen    writes one of the synthetic workloads below as source. all but calls are
+//            main running FUNC 1 four times per turn of an inner loop of 255 turns,
+//            inside an outer loop of --size turns
+//
+//   alu      ADD / NOT / EQU on registers
+//   memory   symbol, REF and pointer moves through the stack frame
+//   calls    a CAL / RET tree four wide and two deep under FUNC 1
+//   print    PRINT heavy, eight values per call
+//
+// build : gcc -O2 -pthread emulator_asm.c -o emulator_asm
+// run   : ./emulator_asm <source> <image> [--addr-bits 16|32]
+//         ./emulator_asm --gen alu|memory|calls|print [--size n] <source>
+
+#define EMU_NO_MAIN
+#include "emulator_001.c"
+
+#include <ctype.h>
+#include <strings.h>
+
+
+//////////////////////////////////////////////////////////////
+///////////////     BIT STREAM WRITER     ////////////////////
+//////////////////////////////////////////////////////////////
+
+// the mirror of bit_reader : fields go in least significant bit first at increasing bit
+// positions, and the bytes are written out last to first, so the reader meets them in
+// the order they were put
+
+// 8 functions of 31 instructions of at most 25 bits, with their headers
+#define BW_BYTES	1024
+
+typedef struct
+{
+	unsigned char bytes[BW_BYTES];
+	int bits;
+} bit_writer;
+
+void bw_put(bit_writer *bw, unsigned int value, int n)
+{
+	for(int i = 0; i<n; ++i, ++bw->bits)
+	{
+		if(value >> i & 1)
+		{
+			bw->bytes[bw->bits >> 3] |= 1 << (bw->bits & 7);
+		}
+	}
+}
+
+// the image in file order, returns its size
+int bw_finish(const bit_writer *bw, unsigned char *out)
+{
+	int n = (bw->bits + 7) >> 3;
+	for(int j = 0; j<n; ++j)
+	{
+		out[n - 1 - j] = bw->bytes[j];
+	}
+	return n;
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////         ASSEMBLER         ////////////////////
+//////////////////////////////////////////////////////////////
+
+#define ASM_MAX_LABELS	256
+#define ASM_NAME		32
+#define ASM_MAX_TOKENS	16
+
+typedef struct
+{
+	// RAM form : opcode, then kind and value of each operand
+	unsigned char ins[5];
+	int line;
+	// label of an @name operand, empty for none. it is always the constant
+	char ref[ASM_NAME];
+} asm_insn;
+
+typedef struct
+{
+	int label;
+	int count;
+	asm_insn ins[31];
+} asm_func;
+
+typedef struct
+{
+	char name[ASM_NAME];
+	// the instruction it labels, index can be count when nothing follows it
+	int func, index;
+} asm_label;
+
+typedef struct
+{
+	asm_func funcs[8];
+	int nfuncs;
+	asm_label labels[ASM_MAX_LABELS];
+	int nlabels;
+} asm_program;
+
+// splits on blanks and commas, returns the number of tokens
+static int asm_split(char *s, char **tok)
+{
+	int n = 0;
+	while(*s && n < ASM_MAX_TOKENS)
+	{
+		while(*s && (isspace((unsigned char)*s) || *s == ','))
+		{
+			*s++ = 0;
+		}
+		if(!*s)
+		{
+			break;
+		}
+		tok[n++] = s;
+		while(*s && !isspace((unsigned char)*s) && *s != ',')
+		{
+			s++;
+		}
+	}
+	return n;
+}
+
+static int asm_number(const char *s, long *v)
+{
+	char *end;
+	*v = strtol(s, &end, 0);
+	return end != s && !*end;
+}
+
+static int asm_symbol(const char *s)
+{
+	const char *c = s[0] && !s[1] ? memchr(stack_symbols, s[0], 32) : NULL;
+	return c ? c - stack_symbols : -1;
+}
+
+// reads operand k of in from tok[*t], either "KIND value" or the short form, and moves *t
+// past it. returns 0 after printing what is wrong with it
+static int asm_operand(char **tok, int n, int *t, asm_insn *in, int k, int line)
+{
+	unsigned char *kind = &in->ins[1 + 2*k], *val = &in->ins[2 + 2*k];
+	const char *s = tok[(*t)++];
+	int explicit = -1;
+	for(int c = 0; c<4; ++c)
+	{
+		if(!strncasecmp(s, argcodes[c], strcspn(argcodes[c], " ")) && !s[strcspn(argcodes[c], " ")])
+		{
+			explicit = c;
+		}
+	}
+	if(explicit >= 0)
+	{
+		if(*t >= n)
+		{
+			printf("L %d : %s without a value\n", line, s);
+			return 0;
+		}
+		s = tok[(*t)++];
+	}
+
+	long v;
+	int sym;
+	if(s[0] == '@' && (explicit < 0 || explicit == CNST))
+	{
+		if(!s[1] || strlen(s + 1) >= ASM_NAME)
+		{
+			printf("L %d : Bad label reference %s\n", line, s);
+			return 0;
+		}
+		strcpy(in->ref, s + 1);
+		*kind = CNST;
+		*val = 0;
+	}
+	else if(s[0] == '[' && (explicit < 0 || explicit == PNTR))
+	{
+		char name[2] = {s[1], 0};
+		sym = s[1] && s[2] == ']' && !s[3] ? asm_symbol(name) : -1;
+		if(sym < 0)
+		{
+			printf("L %d : Bad pointer operand %s, expected [A] .. [g]\n", line, s);
+			return 0;
+		}
+		*kind = PNTR;
+		*val = sym;
+	}
+	else if((s[0] == 'r' || s[0] == 'R') && explicit < 0 && asm_number(s + 1, &v))
+	{
+		if(v < 0 || v > 7)
+		{
+			printf("L %d : No register %s, they are r0 .. r7\n", line, s);
+			return 0;
+		}
+		*kind = RGSTR;
+		*val = v;
+	}
+	else if((sym = asm_symbol(s)) >= 0 && (explicit < 0 || explicit == SYMBL))
+	{
+		*kind = SYMBL;
+		*val = sym;
+	}
+	else if(asm_number(s, &v) && (explicit < 0 || explicit == CNST || explicit == RGSTR))
+	{
+		*kind = explicit < 0 ? CNST : explicit;
+		if(*kind == RGSTR ? v < 0 || v > 7 : v < -128 || v > 255)
+		{
+			printf("L %d : %s out of range for %s\n", line, s, *kind == RGSTR ? "a register" : "an 8 bit constant");
+			return 0;
+		}
+		*val = v;
+	}
+	else
+	{
+		printf("L %d : Cannot read operand %s\n", line, s);
+		return 0;
+	}
+	return 1;
+}
+
+// one line without its comment, returns 0 after printing the errors
+static int asm_line(asm_program *p, char *s, int line)
+{
+	char *tok[ASM_MAX_TOKENS];
+	int n = asm_split(s, tok), t = 0;
+	if(!n || !strcasecmp(tok[0], "ENTRY"))
+	{
+		return 1;
+	}
+
+	if(!strcasecmp(tok[0], "FUNC"))
+	{
+		long label;
+		if(n < 2 || !asm_number(tok[1], &label) || label < 0 || label > 7)
+		{
+			printf("L %d : FUNC needs a label 0 .. 7\n", line);
+			return 0;
+		}
+		for(int j = 0; j<p->nfuncs; ++j)
+		{
+			if(p->funcs[j].label == label)
+			{
+				printf("L %d : Function with label '%ld' already encountered. Ensure functions labels are unique\n", line, label);
+				return 0;
+			}
+		}
+		p->funcs[p->nfuncs].label = label;
+		p->funcs[p->nfuncs++].count = 0;
+		return 1;
+	}
+
+	asm_func *f = p->nfuncs ? &p->funcs[p->nfuncs - 1] : NULL;
+	size_t len = strlen(tok[0]);
+	if(len > 1 && tok[0][len - 1] == ':')
+	{
+		if(!f || len > ASM_NAME || p->nlabels == ASM_MAX_LABELS)
+		{
+			printf(f ? "L %d : Too many labels or label name too long\n" : "L %d : Label outside of a FUNC\n", line);
+			return 0;
+		}
+		tok[0][len - 1] = 0;
+		for(int j = 0; j<p->nlabels; ++j)
+		{
+			if(!strcmp(p->labels[j].name, tok[0]))
+			{
+				printf("L %d : Label %s already defined\n", line, tok[0]);
+				return 0;
+			}
+		}
+		asm_label *l = &p->labels[p->nlabels++];
+		strcpy(l->name, tok[0]);
+		l->func = p->nfuncs - 1;
+		l->index = f->count;
+		if(++t == n)
+		{
+			return 1;
+		}
+	}
+
+	int op = -1;
+	for(int c = 0; c<8; ++c)
+	{
+		if(!strncasecmp(tok[t], opcodes[c], strcspn(opcodes[c], " ")) && !tok[t][strcspn(opcodes[c], " ")])
+		{
+			op = c;
+		}
+	}
+	if(op < 0)
+	{
+		printf("L %d : Unknown instruction %s\n", line, tok[t]);
+		return 0;
+	}
+	if(!f)
+	{
+		printf("L %d : Instruction outside of a FUNC\n", line);
+		return 0;
+	}
+	if(f->count == 31)
+	{
+		printf("L %d : FUNC %d has more than 31 instructions\n", line, f->label);
+		return 0;
+	}
+
+	const insn_layout *l = &layouts[op];
+	asm_insn *in = &f->ins[f->count];
+	memset(in, 0, sizeof(*in));
+	in->ins[0] = op;
+	in->line = line;
+	t++;
+	for(int k = 0; k<l->nargs; ++k)
+	{
+		if(t >= n)
+		{
+			printf("L %d : %.*s takes %d operands\n", line, (int)strcspn(opcodes[op], " "), opcodes[op], l->nargs);
+			return 0;
+		}
+		if(!asm_operand(tok, n, &t, in, k, line))
+		{
+			return 0;
+		}
+		unsigned char kind = in->ins[1 + 2*k];
+		if(!(l->accepts[k] >> kind & 1))
+		{
+			printf("L %d : Illegal arg at position %d of type %s given to op of type : %.*s (expected %s)\n",
+				line, k + 1, argcodes[kind], (int)strcspn(opcodes[op], " "), opcodes[op], l->expects[k]);
+			return 0;
+		}
+	}
+	if(t < n)
+	{
+		printf("L %d : Unexpected %s after %.*s\n", line, tok[t], (int)strcspn(opcodes[op], " "), opcodes[op]);
+		return 0;
+	}
+	if(op == CAL && (in->ins[2] > 7 || in->ref[0]))
+	{
+		printf("L %d : Label of function call exceeds maximum value (7)\n", line);
+		return 0;
+	}
+	f->count++;
+	return 1;
+}
+
+static int insn_size(const asm_insn *in)
+{
+	return 1 + 2*layouts[in->ins[0]].nargs;
+}
+
+// assembles src for a machine with bits wide addresses (8, 16 or 32), which only matters
+// for @name operands. returns the image size with *image malloced, or -1 after printing
+// the errors
+long long assemble(const char *src, int bits, unsigned char **image)
+{
+	asm_program *p = calloc(1, sizeof(asm_program));
+	char *text = strdup(src);
+	int err = 0, line = 0;
+
+	for(char *s = text, *next; s; s = next)
+	{
+		next = strchr(s, '\n');
+		if(next)
+		{
+			*next++ = 0;
+		}
+		line++;
+		s[strcspn(s, ";#")] = 0;
+		if(!asm_line(p, s, line))
+		{
+			err = -1;
+		}
+	}
+	free(text);
+
+	// the loader's layout : functions in source order, each in execution order
+	int size[8] = {0}, code = 0;
+	for(int j = 0; j<p->nfuncs; ++j)
+	{
+		for(int i = 0; i<p->funcs[j].count; ++i)
+		{
+			size[j] += insn_size(&p->funcs[j].ins[i]);
+		}
+		code += size[j];
+	}
+	if(!p->nfuncs)
+	{
+		printf("No functions, a program needs at least FUNC 0\n");
+		err = -1;
+	}
+	if(bits == 8 && code > (1<<8) - 8)
+	{
+		printf("Code is %d bytes, the 8 bit machine holds %d. Assemble with --addr-bits 16 or 32\n", code, (1<<8) - 8);
+		err = -1;
+	}
+	int start[8], cs = bits == 8 ? (1<<8) - code : 8;
+	for(int j = 0, above = 0; j<p->nfuncs; ++j)
+	{
+		above += size[j];
+		start[j] = cs + code - above;
+	}
+
+	for(int j = 0; j<p->nfuncs; ++j)
+	{
+		for(int i = 0; i<p->funcs[j].count; ++i)
+		{
+			asm_insn *in = &p->funcs[j].ins[i];
+			if(!in->ref[0])
+			{
+				continue;
+			}
+			int l = 0;
+			while(l < p->nlabels && strcmp(p->labels[l].name, in->ref))
+			{
+				l++;
+			}
+			if(l == p->nlabels)
+			{
+				printf("L %d : Undefined label %s\n", in->line, in->ref);
+				err = -1;
+				continue;
+			}
+			const asm_func *f = &p->funcs[p->labels[l].func];
+			int addr = start[p->labels[l].func];
+			for(int k = 0; k<p->labels[l].index; ++k)
+			{
+				addr += insn_size(&f->ins[k]);
+			}
+			// MOV r7 then moves PC past itself
+			if(addr - 5 < 0 || addr - 5 > 255)
+			{
+				printf("L %d : Label %s at %d is out of reach of an 8 bit constant\n", in->line, in->ref, addr);
+				err = -1;
+				continue;
+			}
+			// the source of a MOV or the operand of a PRINT
+			in->ins[in->ins[0] == MOV ? 4 : 2] = addr - 5;
+		}
+	}
+	if(err < 0)
+	{
+		free(p);
+		return -1;
+	}
+
+	// each function is its instruction count, the instructions last to first, then its label
+	bit_writer *bw = calloc(1, sizeof(bit_writer));
+	for(int j = 0; j<p->nfuncs; ++j)
+	{
+		const asm_func *f = &p->funcs[j];
+		bw_put(bw, f->count, 5);
+		for(int i = f->count - 1; i >= 0; --i)
+		{
+			const unsigned char *ins = f->ins[i].ins;
+			const insn_layout *l = &layouts[ins[0]];
+			bw_put(bw, ins[0], 3);
+			for(int k = 0; k<l->nargs; ++k)
+			{
+				bw_put(bw, ins[1 + 2*k], l->kind_width);
+				bw_put(bw, ins[2 + 2*k], value_width[ins[1 + 2*k]]);
+			}
+		}
+		bw_put(bw, f->label, 3);
+	}
+	bw_put(bw, 0, 5);
+
+	*image = malloc(BW_BYTES);
+	long long n = bw_finish(bw, *image);
+	free(bw);
+	free(p);
+	return n;
+}
+
+
+//////////////////////////////////////////////////////////////
+///////////////     WORKLOAD GENERATOR    ////////////////////
+//////////////////////////////////////////////////////////////
+
+const char *workloads[4] = {"alu", "memory", "calls", "print"};
+
+// r4 holds all ones, so ADD reg, r4 counts down. reg != 0 goes on at again, 0 falls through.
+// r1 and r2 are scratch
+static void gen_countdown(FILE *f, const char *reg, const char *again)
+{
+	fprintf(f, "\tADD %s, r4\n", reg);
+	// r1 = reg != 0, r2 = 5*r1
+	fprintf(f, "\tMOV r1, %s\n\tEQU r1\n\tEQU r1\n", reg);
+	fprintf(f, "\tMOV r2, r1\n\tADD r2, r2\n\tADD r2, r2\n\tADD r2, r1\n");
+	// ADD then steps over the MOV that leaves the loop
+	fprintf(f, "\tADD r7, r2\n\tMOV r7, @%s_out\n\tMOV r7, @%s\n%s_out:\n", again, again, again);
+}
+
+// 30 instructions and 132 bytes, which leaves FUNC 1 .. 7 116 bytes on the 8 bit machine.
+// registers start at 0, so NOT gives r4 all ones at any register width
+static void gen_main(FILE *f, int size)
+{
+	fprintf(f, "FUNC 0\n\tNOT r4\n\tMOV r3, %d\nouter:\n\tMOV r0, 255\ninner:\n", size);
+	fprintf(f, "\tCAL 1\n\tCAL 1\n\tCAL 1\n\tCAL 1\n");
+	gen_countdown(f, "r0", "inner");
+	gen_countdown(f, "r3", "outer");
+	fprintf(f, "\tRET\n");
+}
+
+// writes workload kind as source, size is the outer loop count (1 .. 255). returns -1
+// for an unknown kind
+int gen_workload(FILE *f, const char *kind, int size)
+{
+	size = size < 1 ? 1 : size > 255 ? 255 : size;
+	fprintf(f, "; %s workload, %d x 255 x 4 calls of FUNC 1\n", kind, size);
+
+	if(!strcmp(kind, "alu"))
+	{
+		gen_main(f, size);
+		fprintf(f, "FUNC 1\n");
+		for(int k = 0; k<3; ++k)
+		{
+			fprintf(f, "\tADD r1, r0\n\tNOT r1\n\tADD r2, r1\n\tEQU r2\n\tADD r2, r0\n\tNOT r2\n\tADD r1, r2\n");
+		}
+		fprintf(f, "\tRET\n");
+	}
+	else if(!strcmp(kind, "memory"))
+	{
+		gen_main(f, size);
+		fprintf(f, "FUNC 1\n\tMOV A, r0\n\tREF B, A\n\tMOV [B], r1\n\tMOV C, [B]\n\tMOV r1, C\n\tADD r1, r0\n\tMOV D, r1\n");
+		fprintf(f, "\tMOV [B], D\n\tMOV r2, A\n\tADD r2, r1\n\tMOV E, r2\n\tREF F, E\n\tMOV [F], r2\n\tMOV r1, [F]\n\tRET\n");
+	}
+	else if(!strcmp(kind, "calls"))
+	{
+		gen_main(f, size);
+		fprintf(f, "FUNC 1\n\tCAL 2\n\tCAL 2\n\tCAL 2\n\tCAL 2\n\tRET\n");
+		fprintf(f, "FUNC 2\n\tCAL 3\n\tCAL 3\n\tCAL 3\n\tCAL 3\n\tRET\n");
+		fprintf(f, "FUNC 3\n\tADD r1, r0\n\tRET\n");
+	}
+	else if(!strcmp(kind, "print"))
+	{
+		gen_main(f, size);
+		fprintf(f, "FUNC 1\n\tPRINT r0\n\tADD r1, r0\n\tPRINT r1\n\tMOV A, r1\n\tPRINT A\n\tNOT r1\n\tPRINT r1\n\tREF B, A\n");
+		fprintf(f, "\tPRINT [B]\n\tPRINT B\n\tPRINT 42\n\tPRINT r3\n\tRET\n");
+	}
+	else
+	{
+		return -1;
+	}
+	return 0;
+}
+
+
+#ifndef EMU_ASM_NO_MAIN
+
+int main(int argc, char const *argv[])
+{
+	if(argc < 3)
+	{
+		printf("usage : %s <source> <image> [--addr-bits 16|32]\n", argv[0]);
+		printf("        %s --gen alu|memory|calls|print [--size n] <source>\n", argv[0]);
+		return -1;
+	}
+
+	if(!strcmp(argv[1], "--gen"))
+	{
+		const char *kind = argv[2], *path = NULL;
+		int size = 255;
+		for(int i = 3; i<argc; ++i)
+		{
+			if(!strcmp(argv[i], "--size") && i + 1 < argc)
+			{
+				size = atoi(argv[++i]);
+			}
+			else
+			{
+				path = argv[i];
+			}
+		}
+		FILE *f = path ? fopen(path, "w") : NULL;
+		if(!f)
+		{
+			printf("Error opening %s\n", path ? path : "output");
+			return -1;
+		}
+		int r = gen_workload(f, kind, size);
+		fclose(f);
+		if(r < 0)
+		{
+			printf("Unknown workload %s\n", kind);
+			remove(path);
+			return -1;
+		}
+		return 0;
+	}
+
+	int bits = 8;
+	for(int i = 3; i<argc; ++i)
+	{
+		if(!strcmp(argv[i], "--addr-bits") && i + 1 < argc)
+		{
+			bits = atoi(argv[++i]);
+		}
+	}
+	if(bits != 8 && bits != 16 && bits != 32)
+	{
+		printf("Address width must be 8, 16 or 32 bits\n");
+		return -1;
+	}
+
+	int fd;
+	off_t res;
+	unsigned char *map = map_file(argv[1], &res, &fd);
+	if(res < 0)
+	{
+		printf("Error reading %s\n", argv[1]);
+		return -1;
+	}
+	char *src = malloc(res + 1);
+	memcpy(src, map, res);
+	src[res] = 0;
+	unmap_file(map, fd, res);
+
+	unsigned char *image;
+	long long n = assemble(src, bits, &image);
+	free(src);
+	if(n < 0)
+	{
+		printf("Fatal errors occured during assembly. Check log messages for more info.\n");
+		return -1;
+	}
+
+	FILE *f = fopen(argv[2], "wb");
+	if(!f || fwrite(image, 1, n, f) != (size_t)n)
+	{
+		printf("Error writing %s\n", argv[2]);
+		return -1;
+	}
+	fclose(f);
+	free(image);
+	printf("%s : %lld byte image\n", argv[2], n);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,247 @@
+// headless benchmark for emulator_001.c
+// assembles the synthetic workloads of emulator_asm.c, or loads the images given on the
+// command line, and prints one row per program, so dispatch, decode, optimizer and native
+// tier changes can be compared on numbers
+//
+// every row :
+//   bytes    code size in RAM
+//   load us  vm_load time, image bit stream to RAM and stack bound, mean over many loads
+//   insns    instructions per run, counted once with the summary trace
+//   best ms  fastest run out of the reps, vm_reset excluded
+//   mean ms  mean run
+//   Minsn/s  insns over best
+//
+// PRINT goes to a checksum instead of stdout, so print measures the VM side of it
+//
+// build : gcc -O2 -pthread emulator_bench.c -o emulator_bench
+// run   : ./emulator_bench [--workloads name,..] [--size n] [--reps k] [--jit] [--optimize]
+//         [--csv] [image ...]
+
+#define EMU_ASM_NO_MAIN
+#include "emulator_asm.c"
+
+
+// least time spent on the loads behind load us
+#define BENCH_LOAD_SECS	0.05
+
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static void bench_print(void *user, unsigned char value)
+{
+	*(unsigned long long *)user += value;
+}
+
+typedef struct
+{
+	int bytes;
+	double load_us;
+	unsigned long long insns;
+	double best, mean;
+	int status;
+	unsigned long long checksum;
+} bench_result;
+
+// returns -1 when the image does not load
+int run_one(const unsigned char *image, long long size, int reps, int jit, int optimize, bench_result *r)
+{
+	vm_context *vm = malloc(sizeof(vm_context));
+	memset(r, 0, sizeof(*r));
+
+	long loads = 0;
+	double t0 = now(), t1;
+	do
+	{
+		if(vm_load(vm, image, size) < 0)
+		{
+			free(vm);
+			return -1;
+		}
+		loads++;
+		t1 = now();
+	}
+	while(t1 - t0 < BENCH_LOAD_SECS);
+	r->load_us = 1e6*(t1 - t0)/loads;
+	r->bytes = (1<<8) - vm->CS;
+
+	if(optimize)
+	{
+		opt_stats st;
+		optimize_image(vm, &st);
+	}
+	vm->print = bench_print;
+	vm->user = &r->checksum;
+
+	// the summary trace runs the hooked loop, so it only counts and is not timed
+	vm_trace trace = {TRACE_SUMMARY, 0, NULL, NULL};
+	vm->trace = &trace;
+	vm_reset(vm);
+	vm_run(vm);
+	r->insns = trace.head;
+	vm->trace = NULL;
+
+	vm->jit = jit ? jit_create() : NULL;
+	r->best = -1;
+	for(int k = 0; k<reps; ++k)
+	{
+		// vm_reset puts back code a self modifying run changed, native code compiled from
+		// the changed bytes has to go with it
+		if(vm->jit && vm->jit->smc)
+		{
+			jit_flush(vm->jit);
+		}
+		vm_reset(vm);
+		t0 = now();
+		r->status = vm_run(vm);
+		t1 = now();
+		if(r->best < 0 || t1 - t0 < r->best)
+		{
+			r->best = t1 - t0;
+		}
+		r->mean += (t1 - t0)/reps;
+	}
+	jit_destroy(vm->jit);
+	free(vm);
+	return 0;
+}
+
+int main(int argc, char const *argv[])
+{
+	const char *names[64];
+	int count = 0;
+	const char *images[64];
+	int nimages = 0;
+	int size = 255;
+	int reps = 5;
+	int jit = 0;
+	int optimize = 0;
+	int csv = 0;
+
+	for(int i = 1; i<argc; ++i)
+	{
+		if(!strcmp(argv[i], "--workloads") && i + 1 < argc)
+		{
+			// split in place on a copy, the names stay alive until exit
+			char *list = strdup(argv[++i]);
+			for(char *s = strtok(list, ","); s && count < 64; s = strtok(NULL, ","))
+			{
+				names[count++] = s;
+			}
+		}
+		else if(!strcmp(argv[i], "--size") && i + 1 < argc)
+		{
+			size = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--reps") && i + 1 < argc)
+		{
+			reps = atoi(argv[++i]);
+			reps = reps < 1 ? 1 : reps;
+		}
+		else if(!strcmp(argv[i], "--jit"))
+		{
+			jit = 1;
+		}
+		else if(!strcmp(argv[i], "--optimize"))
+		{
+			optimize = 1;
+		}
+		else if(!strcmp(argv[i], "--csv"))
+		{
+			csv = 1;
+		}
+		else if(argv[i][0] == '-')
+		{
+			printf("unknown argument %s\n", argv[i]);
+			return -1;
+		}
+		else if(nimages < 64)
+		{
+			images[nimages++] = argv[i];
+		}
+	}
+	// images alone replace the workloads
+	if(!count && !nimages)
+	{
+		for(int k = 0; k<4; ++k)
+		{
+			names[count++] = workloads[k];
+		}
+	}
+
+	if(csv)
+	{
+		printf("program,bytes,load_us,insns,best_ms,mean_ms,minsn_per_s,exit\n");
+	}
+	else
+	{
+		printf("%-16s %6s %8s %12s %9s %9s %9s\n", "program", "bytes", "load us", "insns", "best ms", "mean ms", "Minsn/s");
+	}
+
+	for(int p = 0; p<count + nimages; ++p)
+	{
+		const char *name;
+		unsigned char *image = NULL;
+		long long len;
+		if(p < count)
+		{
+			name = names[p];
+			char *src = NULL;
+			size_t src_len = 0;
+			FILE *f = open_memstream(&src, &src_len);
+			int known = gen_workload(f, name, size) == 0;
+			fclose(f);
+			len = known ? assemble(src, 8, &image) : -1;
+			free(src);
+			if(!known)
+			{
+				printf("unknown workload %s\n", name);
+				continue;
+			}
+		}
+		else
+		{
+			name = images[p - count];
+			int fd;
+			off_t res;
+			unsigned char *map = map_file(name, &res, &fd);
+			len = res;
+			if(res >= 0)
+			{
+				image = malloc(res);
+				memcpy(image, map, res);
+				unmap_file(map, fd, res);
+			}
+		}
+
+		bench_result r;
+		if(len < 0 || run_one(image, len, reps, jit, optimize, &r) < 0)
+		{
+			printf("%s failed to load\n", name);
+			free(image);
+			continue;
+		}
+		free(image);
+
+		double rate = r.best > 0 ? r.insns/r.best*1e-6 : 0;
+		if(csv)
+		{
+			printf("%s,%d,%.3f,%llu,%.4f,%.4f,%.1f,%s\n", name, r.bytes, r.load_us, r.insns,
+				1e3*r.best, 1e3*r.mean, rate, exit_codes[r.status + 2]);
+		}
+		else
+		{
+			printf("%-16s %6d %8.3f %12llu %9.3f %9.3f %9.1f", name, r.bytes, r.load_us, r.insns, 1e3*r.best, 1e3*r.mean, rate);
+			if(r.status != 1)
+			{
+				printf("  exit %d (%s)", r.status, exit_codes[r.status + 2]);
+			}
+			printf("\n");
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
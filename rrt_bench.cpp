@@ -0,0 +1,279 @@
+// headless benchmark for rrt_planner.cpp
+// grows the planner over a fixed set of seeded maps and tree sizes and prints one row
+// per run, so spatial index, sampler and collision changes can be compared on numbers
+// instead of by watching rrt_viz.py
+//
+//   empty    no obstacles, root in the middle, goal near a corner
+//   clutter  150 random convex obstacles (as --clutter 150) minus any on the root or goal
+//   narrow   a wall across the window with a single 12 unit gap
+//   maze     four staggered walls, the way through zigzags from left to right
+//
+// every row is the mean over the seeds:
+//   nodes/s  tree nodes per wall clock second of growth (setup excluded)
+//   nn us    nearest / radius query time per tree node
+//   cc us    collision check time per tree node (grid + GJK)
+//   checks   collision checks per tree node
+//   first    time until the first collision free path into the goal, - if never
+//   cost     path cost at the first solution and at the end of the run
+//   solved   runs that found a path out of the seeds
+//   eager    with --lazy, runs that found a path with the same seeds checked eagerly
+//
+// build : g++ -O2 -std=c++17 -pthread rrt_bench.cpp -o rrt_bench
+// run   : ./rrt_bench [--sizes n,n,..] [--seeds k] [--maps name,..] [--star] [--lazy]
+//         [--sampler uniform|halton|sobol] [--goal-bias f] [--csv]
+
+#define RRT_NO_MAIN
+#include "rrt_planner.cpp"
+
+
+struct bench_map {
+	const char *name;
+	double root_x, root_y;
+	double goal_x, goal_y;
+	obstacle_map map;
+};
+
+vector<point> rect(double x0, double y0, double x1, double y1){
+	return {point(x0, y0), point(x1, y0), point(x1, y1), point(x0, y1)};
+}
+
+bench_map make_map(const char *name, uint64_t seed){
+	bench_map b;
+	b.name = name;
+	b.root_x = 400;
+	b.root_y = 300;
+	b.goal_x = 750;
+	b.goal_y = 550;
+	if(!strcmp(name, "clutter")){
+		// keep the root and goal clear so every seed is solvable in principle
+		obstacle_map all = random_obstacles(150, 0, 800, 0, 600, seed + 1);
+		for(int i = 0; i<(int)all.polys.size(); ++i){
+			const double *r = &all.box[4*i];
+			bool on_root = r[0] < b.root_x + 15 && r[2] > b.root_x - 15 && r[1] < b.root_y + 15 && r[3] > b.root_y - 15;
+			bool on_goal = r[0] < b.goal_x + 15 && r[2] > b.goal_x - 15 && r[1] < b.goal_y + 15 && r[3] > b.goal_y - 15;
+			if(!on_root && !on_goal){
+				b.map.add(all.polys[i]);
+			}
+		}
+	}
+	else if(!strcmp(name, "narrow")){
+		b.root_x = 200;
+		b.goal_x = 650;
+		b.goal_y = 300;
+		b.map.add(rect(390, 0, 410, 294));
+		b.map.add(rect(390, 306, 410, 600));
+	}
+	else if(!strcmp(name, "maze")){
+		b.root_x = 60;
+		b.goal_x = 740;
+		b.goal_y = 300;
+		for(int k = 0; k<4; ++k){
+			double x = 160*(k + 1);
+			if(k % 2 == 0){
+				b.map.add(rect(x - 5, 80, x + 5, 600));
+			}
+			else {
+				b.map.add(rect(x - 5, 0, x + 5, 520));
+			}
+		}
+	}
+	b.map.build(0, 800, 0, 600, 32);
+	return b;
+}
+
+struct bench_result {
+	double secs = 0;
+	int nodes = 0;
+	rrt_stats stats;
+	long long gjk = 0;
+	double first_secs = -1;
+	double first_cost = 0;
+	double final_cost = 0;
+};
+
+bench_result run_one(const bench_map &b, rrt_params prm, int n){
+	prm.root_x = b.root_x;
+	prm.root_y = b.root_y;
+	prm.has_goal = true;
+	prm.goal_x = b.goal_x;
+	prm.goal_y = b.goal_y;
+
+	bool blocked = !b.map.polys.empty();
+	occupancy_grid occ;
+	if(blocked){
+		occ.build(b.map, prm.xlb, prm.xub, prm.ylb, prm.yub, 4);
+	}
+	b.map.narrow_calls = 0;
+
+	bench_result r;
+	rrt tree(prm);
+	tree.reserve(n);
+	tree.stats = &r.stats;
+	if(blocked){
+		tree.obstacles = &b.map;
+		tree.smp.occ = &occ;
+		tree.field = &occ;
+	}
+
+	long long iters = 0;
+	int sol = -1;
+	auto t0 = chrono::steady_clock::now();
+	while(tree.size() < n && iters < 100LL*n){
+		int id = tree.grow();
+		iters++;
+		if(id != -1 && tree.in_goal(id)){
+			sol = tree.solution();
+			if(sol != -1 && r.first_secs < 0){
+				r.first_secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+				r.first_cost = tree.cost[sol];
+			}
+		}
+	}
+	sol = tree.solution();
+	r.secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+	r.nodes = tree.size();
+	r.gjk = b.map.narrow_calls;
+	if(sol != -1){
+		if(r.first_secs < 0){
+			r.first_secs = r.secs;
+			r.first_cost = tree.cost[sol];
+		}
+		r.final_cost = tree.cost[sol];
+	}
+	return r;
+}
+
+vector<string> split(const char *s){
+	vector<string> out;
+	string cur;
+	for(; *s; ++s){
+		if(*s == ','){
+			out.push_back(cur);
+			cur.clear();
+		}
+		else {
+			cur += *s;
+		}
+	}
+	out.push_back(cur);
+	return out;
+}
+
+int main(int argc, char **argv){
+
+	vector<int> sizes = {1000, 10000, 100000};
+	vector<string> maps = {"empty", "clutter", "narrow", "maze"};
+	int seeds = 5;
+	bool csv = false;
+	rrt_params prm;
+
+	for(int i = 1; i<argc; ++i){
+		if(!strcmp(argv[i], "--sizes") && i + 1 < argc){
+			sizes.clear();
+			for(const string &s : split(argv[++i])){
+				sizes.push_back(atoi(s.c_str()));
+			}
+		}
+		else if(!strcmp(argv[i], "--maps") && i + 1 < argc){
+			maps = split(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--seeds") && i + 1 < argc){
+			seeds = max(1, atoi(argv[++i]));
+		}
+		else if(!strcmp(argv[i], "--star")){
+			prm.star = true;
+		}
+		else if(!strcmp(argv[i], "--lazy")){
+			prm.lazy = true;
+		}
+		else if(!strcmp(argv[i], "--sampler") && i + 1 < argc){
+			++i;
+			prm.sample_mode = !strcmp(argv[i], "halton") ? SAMPLE_HALTON : !strcmp(argv[i], "sobol") ? SAMPLE_SOBOL : SAMPLE_UNIFORM;
+		}
+		else if(!strcmp(argv[i], "--goal-bias") && i + 1 < argc){
+			prm.goal_bias = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--csv")){
+			csv = true;
+		}
+		else {
+			cout << "unknown argument " << argv[i] << endl;
+			return -1;
+		}
+	}
+
+	if(csv){
+		printf("map,nodes,nodes_per_s,nn_us,cc_us,checks,gjk,first_s,first_cost,final_cost,solved,seeds%s\n",
+			prm.lazy ? ",eager_solved" : "");
+	}
+	else {
+		printf("%-8s %8s %10s %7s %7s %7s %9s %9s %9s %9s %6s%s\n",
+			"map", "nodes", "nodes/s", "nn us", "cc us", "checks", "gjk", "first s", "cost 1st", "cost end", "solved",
+			prm.lazy ? "  eager" : "");
+	}
+
+	for(const string &name : maps){
+		for(int n : sizes){
+			double secs = 0, nn = 0, cc = 0, checks = 0, gjk = 0;
+			double first = 0, first_cost = 0, final_cost = 0;
+			long long nodes = 0;
+			int solved = 0;
+			int eager_solved = 0;
+			for(int s = 0; s<seeds; ++s){
+				bench_map b = make_map(name.c_str(), s);
+				prm.seed = s;
+				bench_result r = run_one(b, prm, n);
+				if(prm.lazy){
+					rrt_params eager = prm;
+					eager.lazy = false;
+					eager_solved += run_one(b, eager, n).first_secs >= 0;
+				}
+				secs += r.secs;
+				nodes += r.nodes - 1;
+				nn += r.stats.nearest_secs;
+				cc += r.stats.edge_secs;
+				checks += r.stats.edge_checks;
+				gjk += r.gjk;
+				if(r.first_secs >= 0){
+					solved++;
+					first += r.first_secs;
+					first_cost += r.first_cost;
+					final_cost += r.final_cost;
+				}
+			}
+
+			double per_node = nodes ? 1.0/nodes : 0;
+			double rate = secs > 0 ? nodes/secs : 0;
+			if(solved){
+				first /= solved;
+				first_cost /= solved;
+				final_cost /= solved;
+			}
+			if(csv){
+				printf("%s,%d,%.0f,%.3f,%.3f,%.2f,%.0f,%.6f,%.2f,%.2f,%d,%d", name.c_str(), n, rate,
+					1e6*nn*per_node, 1e6*cc*per_node, checks*per_node, gjk/seeds,
+					solved ? first : -1, first_cost, final_cost, solved, seeds);
+			}
+			else if(solved){
+				printf("%-8s %8d %10.0f %7.3f %7.3f %7.2f %9.0f %9.4f %9.1f %9.1f %3d/%-2d", name.c_str(), n, rate,
+					1e6*nn*per_node, 1e6*cc*per_node, checks*per_node, gjk/seeds,
+					first, first_cost, final_cost, solved, seeds);
+			}
+			else {
+				printf("%-8s %8d %10.0f %7.3f %7.3f %7.2f %9.0f %9s %9s %9s %3d/%-2d", name.c_str(), n, rate,
+					1e6*nn*per_node, 1e6*cc*per_node, checks*per_node, gjk/seeds,
+					"-", "-", "-", solved, seeds);
+			}
+			if(prm.lazy && csv){
+				printf(",%d", eager_solved);
+			}
+			else if(prm.lazy){
+				printf(" %3d/%-2d", eager_solved, seeds);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,661 @@
+// CPython extension exposing the GJK and RRT engines (rrt_planner.cpp) to rrt_viz.py
+// arrays go in and out through the buffer protocol, so numpy arrays are read in place
+// and np.asarray() on the returned views does not copy. batch calls drop the GIL
+//
+//   rrt_ext.intersects_many(shape, vertices, offsets) -> uint8 per polygon
+//   rrt_ext.Obstacles(vertices, offsets, footprint=None, bounds=(0, 800, 0, 600), cell=32)
+//       .edges_free(edges)   edges is (n, 4) x0 y0 x1 y1 -> uint8 per edge
+//       .points_free(points) points is (n, 2)            -> uint8 per point
+//   rrt_ext.Planner(seed=0, star=False, lazy=False, maxdist=20, root=(400, 300),
+//                   goal=None, goal_radius=10, obstacles=None, capacity=1<<20,
+//                   sampler="uniform", goal_bias=0)
+//       .grow(n)                     n growth steps, returns the number of nodes added
+//       .grow_to(nodes, threads=1)   grow until the tree has that many nodes
+//       .nearest_many(points)        -> int32 node id per point
+//       .solution()                  -> best goal node id or -1
+//       .path_to(id)                 -> int32 node ids, root first
+//       .points / .parents / .costs  zero-copy views of the node arrays
+//
+// vertices and points are float64 (n, 2), offsets is int32 with one entry per polygon
+// plus the end (polygon i is vertices[offsets[i]:offsets[i+1]]). results come back as
+// bytearrays, wrap them with np.frombuffer(r, np.uint8 / np.int32)
+//
+// the node arrays are reserved up front for capacity nodes. while a view is alive the
+// planner refuses to grow past that, since reallocating would pull the memory out
+// from under it
+//
+// build : g++ -O2 -std=c++17 -pthread -shared -fPIC $(python3-config --includes) rrt_ext.cpp -o rrt_ext$(python3-config --extension-suffix)
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define RRT_NO_MAIN
+#include "rrt_planner.cpp"
+
+
+////////////////////////////////////////////////////////////////
+//////////////////   BUFFER ARGUMENT HELPERS   /////////////////
+////////////////////////////////////////////////////////////////
+
+// true for "d", "<d", "=d" and friends
+static bool has_format(const Py_buffer *v, char code)
+{
+	const char *f = v->format ? v->format : "B";
+	if(*f == '<' || *f == '=' || *f == '@'){
+		f++;
+	}
+	return f[0] == code && f[1] == 0;
+}
+
+// C-contiguous float64 buffer whose length is a multiple of width
+static bool get_doubles(PyObject *o, Py_buffer *v, int width, const char *what)
+{
+	if(PyObject_GetBuffer(o, v, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1){
+		return false;
+	}
+	if(!has_format(v, 'd') || v->itemsize != 8 || (v->len/8) % width){
+		PyErr_Format(PyExc_ValueError, "%s must be a contiguous float64 array with %d columns", what, width);
+		PyBuffer_Release(v);
+		return false;
+	}
+	return true;
+}
+
+static bool get_ints(PyObject *o, Py_buffer *v, const char *what)
+{
+	if(PyObject_GetBuffer(o, v, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1){
+		return false;
+	}
+	if(!has_format(v, 'i') || v->itemsize != 4){
+		PyErr_Format(PyExc_ValueError, "%s must be a contiguous int32 array", what);
+		PyBuffer_Release(v);
+		return false;
+	}
+	return true;
+}
+
+// polygons out of (vertices, offsets)
+static bool get_polygons(PyObject *verts, PyObject *offs, vector<vector<point>> &out)
+{
+	Py_buffer vb, ob;
+	if(!get_doubles(verts, &vb, 2, "vertices")){
+		return false;
+	}
+	if(!get_ints(offs, &ob, "offsets")){
+		PyBuffer_Release(&vb);
+		return false;
+	}
+
+	const double *v = (const double *)vb.buf;
+	const int *o = (const int *)ob.buf;
+	Py_ssize_t nv = vb.len/16, no = ob.len/4;
+	bool ok = true;
+	for(Py_ssize_t i = 0; i + 1 < no; ++i){
+		if(o[i] < 0 || o[i + 1] <= o[i] || o[i + 1] > nv){
+			PyErr_SetString(PyExc_ValueError, "offsets must be increasing and inside vertices");
+			ok = false;
+			break;
+		}
+		vector<point> poly;
+		for(int k = o[i]; k<o[i + 1]; ++k){
+			poly.push_back(point(v[2*k], v[2*k + 1]));
+		}
+		out.push_back(poly);
+	}
+
+	PyBuffer_Release(&vb);
+	PyBuffer_Release(&ob);
+	return ok;
+}
+
+static vector<point> to_points(const Py_buffer &b)
+{
+	const double *v = (const double *)b.buf;
+	vector<point> pts;
+	for(Py_ssize_t k = 0; k<b.len/16; ++k){
+		pts.push_back(point(v[2*k], v[2*k + 1]));
+	}
+	return pts;
+}
+
+
+////////////////////////////////////////////////////////////////
+///////////////////////   OBSTACLES   //////////////////////////
+////////////////////////////////////////////////////////////////
+
+struct obstacles_object {
+	PyObject_HEAD
+	obstacle_map *map;
+};
+
+static PyTypeObject obstacles_type = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static int obstacles_init(obstacles_object *self, PyObject *args, PyObject *kw)
+{
+	static const char *kwlist[] = {"vertices", "offsets", "footprint", "bounds", "cell", NULL};
+	PyObject *verts, *offs, *foot = Py_None;
+	double xlb = 0, xub = 800, ylb = 0, yub = 600, cell = 32;
+
+	if(!PyArg_ParseTupleAndKeywords(args, kw, "OO|O(dddd)d", (char **)kwlist,
+			&verts, &offs, &foot, &xlb, &xub, &ylb, &yub, &cell)){
+		return -1;
+	}
+
+	// planners hold on to the map, it cannot be swapped out under them
+	if(self->map){
+		PyErr_SetString(PyExc_RuntimeError, "Obstacles already initialized");
+		return -1;
+	}
+
+	vector<vector<point>> polys;
+	if(!get_polygons(verts, offs, polys)){
+		return -1;
+	}
+
+	obstacle_map *map = new obstacle_map();
+	for(const vector<point> &p : polys){
+		map->add(p);
+	}
+	if(foot != Py_None){
+		Py_buffer fb;
+		if(!get_doubles(foot, &fb, 2, "footprint")){
+			delete map;
+			return -1;
+		}
+		map->footprint = to_points(fb);
+		PyBuffer_Release(&fb);
+	}
+	map->build(xlb, xub, ylb, yub, cell);
+	self->map = map;
+	return 0;
+}
+
+static void obstacles_dealloc(obstacles_object *self)
+{
+	delete self->map;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// shared body of edges_free / points_free, width 4 for edges and 2 for points
+static PyObject *obstacles_query(obstacles_object *self, PyObject *arg, int width)
+{
+	if(!self->map){
+		PyErr_SetString(PyExc_RuntimeError, "Obstacles not initialized");
+		return NULL;
+	}
+	Py_buffer b;
+	if(!get_doubles(arg, &b, width, width == 4 ? "edges" : "points")){
+		return NULL;
+	}
+	Py_ssize_t n = b.len/(8*width);
+	PyObject *res = PyByteArray_FromStringAndSize(NULL, n);
+	if(!res){
+		PyBuffer_Release(&b);
+		return NULL;
+	}
+
+	const double *q = (const double *)b.buf;
+	unsigned char *out = (unsigned char *)PyByteArray_AS_STRING(res);
+	const obstacle_map *map = self->map;
+
+	Py_BEGIN_ALLOW_THREADS
+	for(Py_ssize_t i = 0; i<n; ++i){
+		const double *e = q + width*i;
+		out[i] = width == 4 ? map->edge_free(e[0], e[1], e[2], e[3]) : map->point_free(e[0], e[1]);
+	}
+	Py_END_ALLOW_THREADS
+
+	PyBuffer_Release(&b);
+	return res;
+}
+
+static PyObject *obstacles_edges_free(obstacles_object *self, PyObject *arg)
+{
+	return obstacles_query(self, arg, 4);
+}
+
+static PyObject *obstacles_points_free(obstacles_object *self, PyObject *arg)
+{
+	return obstacles_query(self, arg, 2);
+}
+
+static PyObject *obstacles_len(obstacles_object *self, PyObject *unused)
+{
+	return PyLong_FromSsize_t(self->map ? self->map->polys.size() : 0);
+}
+
+static PyMethodDef obstacles_methods[] = {
+	{"edges_free", (PyCFunction)obstacles_edges_free, METH_O, "uint8 per (x0, y0, x1, y1) row, 1 when the swept edge is clear"},
+	{"points_free", (PyCFunction)obstacles_points_free, METH_O, "uint8 per (x, y) row, 1 when the footprint there is clear"},
+	{"count", (PyCFunction)obstacles_len, METH_NOARGS, "number of obstacles"},
+	{NULL, NULL, 0, NULL},
+};
+
+
+////////////////////////////////////////////////////////////////
+////////////////////////   PLANNER   ////////////////////////////
+////////////////////////////////////////////////////////////////
+
+struct planner_object {
+	PyObject_HEAD
+	rrt *tree;
+	PyObject *obstacles;
+	int capacity;
+
+	// live buffer views of the node arrays
+	int exports;
+
+	// set while a call runs without the GIL
+	bool busy;
+};
+
+static PyTypeObject planner_type = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static int planner_init(planner_object *self, PyObject *args, PyObject *kw)
+{
+	static const char *kwlist[] = {"seed", "star", "lazy", "maxdist", "root", "goal",
+		"goal_radius", "obstacles", "capacity", "sampler", "goal_bias", NULL};
+	rrt_params prm;
+	unsigned long long seed = 0;
+	int star = 0, lazy = 0, capacity = 1<<20;
+	PyObject *goal = Py_None, *obs = Py_None;
+	const char *mode = "uniform";
+
+	if(!PyArg_ParseTupleAndKeywords(args, kw, "|Kppd(dd)OdOisd", (char **)kwlist,
+			&seed, &star, &lazy, &prm.maxdist, &prm.root_x, &prm.root_y, &goal,
+			&prm.goal_radius, &obs, &capacity, &mode, &prm.goal_bias)){
+		return -1;
+	}
+	if(!strcmp(mode, "uniform")){
+		prm.sample_mode = SAMPLE_UNIFORM;
+	}
+	else if(!strcmp(mode, "halton")){
+		prm.sample_mode = SAMPLE_HALTON;
+	}
+	else if(!strcmp(mode, "sobol")){
+		prm.sample_mode = SAMPLE_SOBOL;
+	}
+	else {
+		PyErr_SetString(PyExc_ValueError, "sampler must be uniform, halton or sobol");
+		return -1;
+	}
+	if(goal != Py_None){
+		if(!PyArg_ParseTuple(goal, "dd", &prm.goal_x, &prm.goal_y)){
+			return -1;
+		}
+		prm.has_goal = true;
+	}
+	if(obs != Py_None && !PyObject_TypeCheck(obs, &obstacles_type)){
+		PyErr_SetString(PyExc_TypeError, "obstacles must be an rrt_ext.Obstacles");
+		return -1;
+	}
+	if(self->exports || self->busy){
+		PyErr_SetString(PyExc_BufferError, "planner is in use");
+		return -1;
+	}
+	prm.seed = seed;
+	prm.star = star;
+	prm.lazy = lazy;
+
+	delete self->tree;
+	self->tree = new rrt(prm);
+	self->capacity = max(capacity, 1);
+	self->tree->reserve(self->capacity);
+
+	Py_CLEAR(self->obstacles);
+	if(obs != Py_None){
+		Py_INCREF(obs);
+		self->obstacles = obs;
+		self->tree->obstacles = ((obstacles_object *)obs)->map;
+	}
+	return 0;
+}
+
+static void planner_dealloc(planner_object *self)
+{
+	delete self->tree;
+	Py_CLEAR(self->obstacles);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+// common entry check, nodes is how many nodes the call may add
+static bool planner_acquire(planner_object *self, long long nodes)
+{
+	if(!self->tree){
+		PyErr_SetString(PyExc_RuntimeError, "Planner not initialized");
+		return false;
+	}
+	if(self->busy){
+		PyErr_SetString(PyExc_RuntimeError, "Planner is already running on another thread");
+		return false;
+	}
+	// calls that add nothing never reallocate, whatever the size
+	if(self->exports && nodes > 0 && self->tree->size() + nodes > self->capacity){
+		PyErr_SetString(PyExc_BufferError, "growing past capacity while node views are alive");
+		return false;
+	}
+	self->busy = true;
+	return true;
+}
+
+static PyObject *planner_grow(planner_object *self, PyObject *args)
+{
+	long long steps;
+	if(!PyArg_ParseTuple(args, "L", &steps) || !planner_acquire(self, steps)){
+		return NULL;
+	}
+	rrt *t = self->tree;
+	int before = t->size();
+
+	Py_BEGIN_ALLOW_THREADS
+	for(long long i = 0; i<steps; ++i){
+		t->grow();
+	}
+	Py_END_ALLOW_THREADS
+
+	self->busy = false;
+	return PyLong_FromLong(t->size() - before);
+}
+
+static PyObject *planner_grow_to(planner_object *self, PyObject *args, PyObject *kw)
+{
+	static const char *kwlist[] = {"nodes", "threads", NULL};
+	int nodes, threads = 1;
+	if(!PyArg_ParseTupleAndKeywords(args, kw, "i|i", (char **)kwlist, &nodes, &threads)){
+		return NULL;
+	}
+	if(!planner_acquire(self, self->tree ? max(0, nodes - self->tree->size()) : 0)){
+		return NULL;
+	}
+	rrt *t = self->tree;
+
+	Py_BEGIN_ALLOW_THREADS
+	t->grow_parallel(nodes, threads);
+	Py_END_ALLOW_THREADS
+
+	self->busy = false;
+	return PyLong_FromLong(t->size());
+}
+
+static PyObject *planner_nearest_many(planner_object *self, PyObject *arg)
+{
+	Py_buffer b;
+	if(!planner_acquire(self, 0)){
+		return NULL;
+	}
+	if(!get_doubles(arg, &b, 2, "points")){
+		self->busy = false;
+		return NULL;
+	}
+	Py_ssize_t n = b.len/16;
+	PyObject *res = PyByteArray_FromStringAndSize(NULL, n*sizeof(int32_t));
+	if(res){
+		const double *q = (const double *)b.buf;
+		int32_t *out = (int32_t *)PyByteArray_AS_STRING(res);
+		const rrt *t = self->tree;
+
+		Py_BEGIN_ALLOW_THREADS
+		double d;
+		for(Py_ssize_t i = 0; i<n; ++i){
+			out[i] = t->get_nearest(q[2*i], q[2*i + 1], d);
+		}
+		Py_END_ALLOW_THREADS
+	}
+	PyBuffer_Release(&b);
+	self->busy = false;
+	return res;
+}
+
+static PyObject *planner_solution(planner_object *self, PyObject *unused)
+{
+	if(!planner_acquire(self, 0)){
+		return NULL;
+	}
+	int id = self->tree->solution();
+	self->busy = false;
+	return PyLong_FromLong(id);
+}
+
+static PyObject *planner_path_to(planner_object *self, PyObject *args)
+{
+	int id;
+	if(!PyArg_ParseTuple(args, "i", &id) || !planner_acquire(self, 0)){
+		return NULL;
+	}
+	self->busy = false;
+	if(id < 0 || id >= self->tree->size()){
+		PyErr_SetString(PyExc_IndexError, "node id out of range");
+		return NULL;
+	}
+	vector<int> path = self->tree->path_to(id);
+	return PyByteArray_FromStringAndSize((const char *)path.data(), path.size()*sizeof(int));
+}
+
+static PyObject *planner_size(planner_object *self, PyObject *unused)
+{
+	return PyLong_FromLong(self->tree ? self->tree->size() : 0);
+}
+
+
+// zero-copy views of one node array, keeping the planner alive and counted as an export
+
+#define VIEW_POINTS 0
+#define VIEW_PARENTS 1
+#define VIEW_COSTS 2
+
+struct view_object {
+	PyObject_HEAD
+	planner_object *owner;
+	int which;
+};
+
+static PyTypeObject view_type = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static PyObject *make_view(planner_object *self, int which)
+{
+	if(!self->tree){
+		PyErr_SetString(PyExc_RuntimeError, "Planner not initialized");
+		return NULL;
+	}
+	view_object *v = PyObject_New(view_object, &view_type);
+	if(!v){
+		return NULL;
+	}
+	Py_INCREF(self);
+	v->owner = self;
+	v->which = which;
+	return (PyObject *)v;
+}
+
+static PyObject *planner_points(planner_object *self, void *unused) { return make_view(self, VIEW_POINTS); }
+static PyObject *planner_parents(planner_object *self, void *unused) { return make_view(self, VIEW_PARENTS); }
+static PyObject *planner_costs(planner_object *self, void *unused) { return make_view(self, VIEW_COSTS); }
+
+static void view_dealloc(view_object *self)
+{
+	Py_DECREF(self->owner);
+	PyObject_Del(self);
+}
+
+// the shape is fixed when the buffer is taken, nodes added later are not visible
+// through an existing numpy array, take a new one
+static int view_getbuffer(view_object *self, Py_buffer *view, int flags)
+{
+	planner_object *p = self->owner;
+	view->obj = NULL;
+	if(p->busy){
+		PyErr_SetString(PyExc_BufferError, "planner is running");
+		return -1;
+	}
+	if((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE){
+		PyErr_SetString(PyExc_BufferError, "node views are read-only");
+		return -1;
+	}
+
+	// shape and strides live as long as this export, the next one may see more nodes
+	Py_ssize_t *dims = (Py_ssize_t *)PyMem_Malloc(4*sizeof(Py_ssize_t));
+	if(!dims){
+		PyErr_NoMemory();
+		return -1;
+	}
+	rrt *t = p->tree;
+	Py_ssize_t n = t->size();
+
+	view->obj = (PyObject *)self;
+	view->readonly = 1;
+	view->suboffsets = NULL;
+	view->internal = dims;
+	view->shape = dims;
+	view->strides = dims + 2;
+	view->shape[0] = n;
+
+	switch(self->which)
+	{
+		case VIEW_POINTS:
+		view->buf = t->xy.data();
+		view->itemsize = sizeof(double);
+		view->format = (flags & PyBUF_FORMAT) ? (char *)"d" : NULL;
+		view->ndim = 2;
+		view->shape[1] = 2;
+		view->strides[0] = 2*sizeof(double);
+		view->strides[1] = sizeof(double);
+		break;
+		case VIEW_PARENTS:
+		view->buf = t->parent.data();
+		view->itemsize = sizeof(int);
+		view->format = (flags & PyBUF_FORMAT) ? (char *)"i" : NULL;
+		view->ndim = 1;
+		view->strides[0] = sizeof(int);
+		break;
+		case VIEW_COSTS:
+		view->buf = t->cost.data();
+		view->itemsize = sizeof(double);
+		view->format = (flags & PyBUF_FORMAT) ? (char *)"d" : NULL;
+		view->ndim = 1;
+		view->strides[0] = sizeof(double);
+		break;
+	}
+	view->len = n*view->itemsize*(view->ndim == 2 ? 2 : 1);
+
+	Py_INCREF(self);
+	p->exports++;
+	return 0;
+}
+
+static void view_releasebuffer(view_object *self, Py_buffer *view)
+{
+	PyMem_Free(view->internal);
+	self->owner->exports--;
+}
+
+static PyBufferProcs view_as_buffer = {
+	(getbufferproc)view_getbuffer,
+	(releasebufferproc)view_releasebuffer,
+};
+
+static PyMethodDef planner_methods[] = {
+	{"grow", (PyCFunction)planner_grow, METH_VARARGS, "grow(n): run n growth steps, returns the number of nodes added"},
+	{"grow_to", (PyCFunction)(void (*)(void))planner_grow_to, METH_VARARGS | METH_KEYWORDS, "grow_to(nodes, threads=1): grow until the tree has that many nodes"},
+	{"nearest_many", (PyCFunction)planner_nearest_many, METH_O, "nearest node id (int32) per (x, y) row"},
+	{"solution", (PyCFunction)planner_solution, METH_NOARGS, "cheapest goal node with a valid path, or -1"},
+	{"path_to", (PyCFunction)planner_path_to, METH_VARARGS, "node ids (int32) from the root to the given node"},
+	{"size", (PyCFunction)planner_size, METH_NOARGS, "number of nodes"},
+	{NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef planner_getset[] = {
+	{"points", (getter)planner_points, NULL, "(n, 2) float64 node positions", NULL},
+	{"parents", (getter)planner_parents, NULL, "(n,) int32 parent ids, -1 for the root and cut off nodes", NULL},
+	{"costs", (getter)planner_costs, NULL, "(n,) float64 cost-to-come", NULL},
+	{NULL, NULL, NULL, NULL, NULL},
+};
+
+
+////////////////////////////////////////////////////////////////
+////////////////////////   MODULE   /////////////////////////////
+////////////////////////////////////////////////////////////////
+
+static PyObject *ext_intersects_many(PyObject *mod, PyObject *args)
+{
+	PyObject *shape, *verts, *offs;
+	if(!PyArg_ParseTuple(args, "OOO", &shape, &verts, &offs)){
+		return NULL;
+	}
+	Py_buffer sb;
+	if(!get_doubles(shape, &sb, 2, "shape")){
+		return NULL;
+	}
+	vector<point> s = to_points(sb);
+	PyBuffer_Release(&sb);
+	if(s.empty()){
+		PyErr_SetString(PyExc_ValueError, "shape is empty");
+		return NULL;
+	}
+
+	vector<vector<point>> polys;
+	if(!get_polygons(verts, offs, polys)){
+		return NULL;
+	}
+	PyObject *res = PyByteArray_FromStringAndSize(NULL, polys.size());
+	if(!res){
+		return NULL;
+	}
+	unsigned char *out = (unsigned char *)PyByteArray_AS_STRING(res);
+
+	Py_BEGIN_ALLOW_THREADS
+	for(size_t i = 0; i<polys.size(); ++i){
+		out[i] = intersects(s, polys[i]);
+	}
+	Py_END_ALLOW_THREADS
+
+	return res;
+}
+
+static PyMethodDef ext_methods[] = {
+	{"intersects_many", ext_intersects_many, METH_VARARGS, "intersects_many(shape, vertices, offsets): uint8 per polygon, 1 when it touches shape"},
+	{NULL, NULL, 0, NULL},
+};
+
+static PyModuleDef ext_module = {
+	PyModuleDef_HEAD_INIT, "rrt_ext", "native GJK and RRT engines for rrt_viz.py", -1, ext_methods,
+};
+
+PyMODINIT_FUNC PyInit_rrt_ext(void)
+{
+	obstacles_type.tp_name = "rrt_ext.Obstacles";
+	obstacles_type.tp_basicsize = sizeof(obstacles_object);
+	obstacles_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	obstacles_type.tp_new = PyType_GenericNew;
+	obstacles_type.tp_init = (initproc)obstacles_init;
+	obstacles_type.tp_dealloc = (destructor)obstacles_dealloc;
+	obstacles_type.tp_methods = obstacles_methods;
+
+	planner_type.tp_name = "rrt_ext.Planner";
+	planner_type.tp_basicsize = sizeof(planner_object);
+	planner_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	planner_type.tp_new = PyType_GenericNew;
+	planner_type.tp_init = (initproc)planner_init;
+	planner_type.tp_dealloc = (destructor)planner_dealloc;
+	planner_type.tp_methods = planner_methods;
+	planner_type.tp_getset = planner_getset;
+
+	view_type.tp_name = "rrt_ext.NodeView";
+	view_type.tp_basicsize = sizeof(view_object);
+	view_type.tp_flags = Py_TPFLAGS_DEFAULT;
+	view_type.tp_dealloc = (destructor)view_dealloc;
+	view_type.tp_as_buffer = &view_as_buffer;
+
+	if(PyType_Ready(&obstacles_type) < 0 || PyType_Ready(&planner_type) < 0 || PyType_Ready(&view_type) < 0){
+		return NULL;
+	}
+
+	PyObject *m = PyModule_Create(&ext_module);
+	if(!m){
+		return NULL;
+	}
+	Py_INCREF(&obstacles_type);
+	Py_INCREF(&planner_type);
+	PyModule_AddObject(m, "Obstacles", (PyObject *)&obstacles_type);
+	PyModule_AddObject(m, "Planner", (PyObject *)&planner_type);
+	return m;
+}
@@ -0,0 +1,1757 @@
+// headless C++ core for the planner drawn by rrt_viz.py
+// keeps the grow_rrt / enforce_dist_limits semantics but nodes live in flat arrays
+// indexed by insertion order (node 0 is the root), and the nearest neighbour
+// comes from a 2d kd-tree that is built incrementally over those same indices
+// so one growth step is O(log n) on average instead of the linear get_nearest() scan
+//
+// with star set the planner runs RRT*: every node carries its cost-to-come, new nodes
+// pick the cheapest parent among a shrinking radius neighbourhood and then rewire
+// that neighbourhood through themselves. cost changes are pushed down the rewired
+// subtree only, never through the whole tree
+//
+// with an obstacle_map attached every extend (and every RRT* parent / rewire edge)
+// is checked against polygon obstacles. the edge, or the robot footprint swept along
+// it, is handed to the GJK in Gilbert-Johnson-Keerthi.cpp as a convex point cloud,
+// after a bucket grid over the obstacle bounding boxes has thrown out everything
+// that is not near the edge
+//
+// lazy mode skips those checks while growing. edges are only validated once they lie
+// on the current best path into the goal region; a failing edge is cached as bad, its
+// subtree is cut off and the planner tries to hang the cut off nodes under other
+// neighbours before trying the next candidate path
+//
+// grow_parallel runs plain RRT on several worker threads that sample, query and
+// collision check at the same time. the node arrays are sized up front, a worker
+// claims a slot with one atomic add once it has a valid extension, fills it in and
+// then publishes it with a CAS into the parent's child list and into the kd-tree.
+// kd-tree links are read with acquire loads so queries can run during insertion
+//
+// rrt_connect grows one plain tree from the root and one from the goal, sharing the
+// kd-tree / obstacle_map machinery. every extension of one tree is followed by a
+// greedy connect of the other tree towards the new node, and the search stops as
+// soon as the two meet
+//
+// with a tree_log attached the planner appends every structural change to a compact
+// binary file (see tree_log below) instead of driving a window. rrt_viz.py tails that
+// file and draws in batches, and the same file replays a finished run
+//
+// samples come from a block sampler (uniform, halton or sobol, optionally goal biased)
+// that drops samples falling in cells known to be inside an obstacle before the
+// planner spends a nearest neighbour query on them
+//
+// an occupancy_grid (tiled signed distance field over the obstacles) answers the easy
+// edge checks, clearly free or clearly blocked, before anything reaches GJK
+//
+// build : g++ -O2 -std=c++17 -pthread rrt_planner.cpp -o rrt_planner
+// run   : ./rrt_planner [nodes] [seed] [--star] [--lazy] [--clutter n] [--goal x y] [--threads n] [--connect] [--log file]
+//         [--sampler uniform|halton|sobol] [--goal-bias f]
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <unordered_set>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+#define GJK_NO_MAIN
+#include "Gilbert-Johnson-Keerthi.cpp"
+
+
+// kd-tree over the planner's node array
+// no rebalancing: nodes are inserted in sampling order, which is random enough
+// to keep the expected depth logarithmic. split axis alternates with depth (x first)
+
+struct kd_tree {
+
+	const vector<double> *xy = nullptr;
+
+	// nodes with alive[id] == 0 stay in the tree (there is no removal) but are
+	// never returned by a query. null means everything is alive
+	const vector<unsigned char> *alive = nullptr;
+
+	vector<int> left;
+	vector<int> right;
+	int root = -1;
+
+	double coord(int id, int axis) const { return (*xy)[2*id + axis]; }
+
+	double dist2(int id, double x, double y) const {
+		double dx = (*xy)[2*id] - x, dy = (*xy)[2*id + 1] - y;
+		return dx*dx + dy*dy;
+	}
+
+	// child links may be written by insert_concurrent while a query runs.
+	// on x86 this is a plain load, so the sequential planner pays nothing for it
+	static int link(const int &slot) { return __atomic_load_n(&slot, __ATOMIC_ACQUIRE); }
+
+	// id must already have its coordinates in xy
+	void insert(int id){
+		if((int)left.size() <= id){
+			left.resize(id + 1, -1);
+			right.resize(id + 1, -1);
+		}
+		if(root == -1){
+			root = id;
+			return;
+		}
+		int n = root, depth = 0;
+		while(true){
+			int axis = depth & 1;
+			int &next = coord(id, axis) < coord(n, axis) ? left[n] : right[n];
+			if(next == -1){
+				next = id;
+				return;
+			}
+			n = next;
+			depth++;
+		}
+	}
+
+	// returns -1 on an empty tree, best_d2 is the squared distance to the result
+	int nearest(double x, double y, double &best_d2) const {
+		struct entry { int n, depth; double lb; };
+		static thread_local vector<entry> stack;
+
+		int best = -1;
+		best_d2 = INFINITY;
+		if(root == -1){
+			return best;
+		}
+
+		stack.clear();
+		stack.push_back({root, 0, 0.0});
+		while(!stack.empty()){
+			entry e = stack.back();
+			stack.pop_back();
+			if(e.lb >= best_d2){
+				continue;
+			}
+			double d2 = dist2(e.n, x, y);
+			if(d2 < best_d2 && (!alive || (*alive)[e.n])){
+				best_d2 = d2;
+				best = e.n;
+			}
+			int axis = e.depth & 1;
+			double diff = (axis ? y : x) - coord(e.n, axis);
+			int near_side = link(diff < 0 ? left[e.n] : right[e.n]);
+			int far_side = link(diff < 0 ? right[e.n] : left[e.n]);
+
+			// far side first so the near side is popped first
+			if(far_side != -1 && diff*diff < best_d2){
+				stack.push_back({far_side, e.depth + 1, diff*diff});
+			}
+			if(near_side != -1){
+				stack.push_back({near_side, e.depth + 1, e.lb});
+			}
+		}
+		return best;
+	}
+
+	// insert for concurrent writers: the arrays must already be sized past id, left[id]
+	// and right[id] must be -1 and the root must exist. losing a CAS race just means
+	// continuing the descent from whoever won it
+	void insert_concurrent(int id){
+		int n = root, depth = 0;
+		while(true){
+			int axis = depth & 1;
+			int *slot = coord(id, axis) < coord(n, axis) ? &left[n] : &right[n];
+			int next = link(*slot);
+			if(next == -1){
+				if(__atomic_compare_exchange_n(slot, &next, id, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)){
+					return;
+				}
+			}
+			n = next;
+			depth++;
+		}
+	}
+
+	// appends every id within sqrt(r2) of (x, y) to out
+	void near(double x, double y, double r2, vector<int> &out) const {
+		struct entry { int n, depth; };
+		static thread_local vector<entry> stack;
+
+		if(root == -1){
+			return;
+		}
+
+		stack.clear();
+		stack.push_back({root, 0});
+		while(!stack.empty()){
+			entry e = stack.back();
+			stack.pop_back();
+			if(dist2(e.n, x, y) <= r2 && (!alive || (*alive)[e.n])){
+				out.push_back(e.n);
+			}
+			int axis = e.depth & 1;
+			double diff = (axis ? y : x) - coord(e.n, axis);
+			int near_side = link(diff < 0 ? left[e.n] : right[e.n]);
+			int far_side = link(diff < 0 ? right[e.n] : left[e.n]);
+			if(far_side != -1 && diff*diff <= r2){
+				stack.push_back({far_side, e.depth + 1});
+			}
+			if(near_side != -1){
+				stack.push_back({near_side, e.depth + 1});
+			}
+		}
+	}
+
+	// the k nearest ids to (x, y), nearest first. same walk as nearest() with the
+	// current k-th distance as the bound, kept in a max-heap
+	void nearest_k(double x, double y, int k, vector<int> &out) const {
+		struct entry { int n, depth; double lb; };
+		static thread_local vector<entry> stack;
+		static thread_local vector<pair<double, int>> heap;
+
+		out.clear();
+		if(root == -1 || k <= 0){
+			return;
+		}
+
+		heap.clear();
+		stack.clear();
+		stack.push_back({root, 0, 0.0});
+		while(!stack.empty()){
+			entry e = stack.back();
+			stack.pop_back();
+			double bound = (int)heap.size() == k ? heap.front().first : INFINITY;
+			if(e.lb >= bound){
+				continue;
+			}
+			double d2 = dist2(e.n, x, y);
+			if(d2 < bound && (!alive || (*alive)[e.n])){
+				if((int)heap.size() == k){
+					pop_heap(heap.begin(), heap.end());
+					heap.pop_back();
+				}
+				heap.push_back({d2, e.n});
+				push_heap(heap.begin(), heap.end());
+				bound = (int)heap.size() == k ? heap.front().first : INFINITY;
+			}
+			int axis = e.depth & 1;
+			double diff = (axis ? y : x) - coord(e.n, axis);
+			int near_side = link(diff < 0 ? left[e.n] : right[e.n]);
+			int far_side = link(diff < 0 ? right[e.n] : left[e.n]);
+			if(far_side != -1 && diff*diff < bound){
+				stack.push_back({far_side, e.depth + 1, diff*diff});
+			}
+			if(near_side != -1){
+				stack.push_back({near_side, e.depth + 1, e.lb});
+			}
+		}
+		sort_heap(heap.begin(), heap.end());
+		for(auto &h : heap){
+			out.push_back(h.second);
+		}
+	}
+};
+
+
+// convex polygon obstacles plus a uniform bucket grid over their bounding boxes
+// every obstacle is listed in each cell its box touches (CSR layout: cell_start / cell_items)
+
+struct obstacle_map {
+
+	vector<vector<point>> polys;
+
+	// xmin, ymin, xmax, ymax per obstacle
+	vector<double> box;
+
+	// robot shape relative to its reference point, empty for a point robot
+	vector<point> footprint;
+
+	double x0 = 0, y0 = 0, cell = 32;
+	int nx = 0, ny = 0;
+	vector<int> cell_start;
+	vector<int> cell_items;
+
+	// number of GJK calls made, the grid and box tests are not counted
+	mutable long long narrow_calls = 0;
+
+	void add(const vector<point> &poly){
+		double b[4] = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+		for(const point &p : poly){
+			b[0] = min(b[0], p.x);
+			b[1] = min(b[1], p.y);
+			b[2] = max(b[2], p.x);
+			b[3] = max(b[3], p.y);
+		}
+		polys.push_back(poly);
+		box.insert(box.end(), b, b + 4);
+	}
+
+	// moves obstacle i, returns the union of its old and new box for
+	// occupancy_grid::rebuild_region. the bucket grid is rebuilt over the same area
+	void replace(int i, const vector<point> &poly, double region[4]){
+		double *b = &box[4*i];
+		region[0] = b[0];
+		region[1] = b[1];
+		region[2] = b[2];
+		region[3] = b[3];
+		b[0] = b[1] = INFINITY;
+		b[2] = b[3] = -INFINITY;
+		for(const point &p : poly){
+			b[0] = min(b[0], p.x);
+			b[1] = min(b[1], p.y);
+			b[2] = max(b[2], p.x);
+			b[3] = max(b[3], p.y);
+		}
+		polys[i] = poly;
+		region[0] = min(region[0], b[0]);
+		region[1] = min(region[1], b[1]);
+		region[2] = max(region[2], b[2]);
+		region[3] = max(region[3], b[3]);
+		build(x0, x0 + nx*cell, y0, y0 + ny*cell, cell);
+	}
+
+	int cell_x(double x) const { return min(max((int)floor((x - x0)/cell), 0), nx - 1); }
+	int cell_y(double y) const { return min(max((int)floor((y - y0)/cell), 0), ny - 1); }
+
+	// call once after all obstacles are added, the grid covers [xlb, xub] x [ylb, yub]
+	// and anything outside is clamped into the border cells
+	void build(double xlb, double xub, double ylb, double yub, double cell_size){
+		x0 = xlb;
+		y0 = ylb;
+		cell = cell_size;
+		nx = max(1, (int)ceil((xub - xlb)/cell));
+		ny = max(1, (int)ceil((yub - ylb)/cell));
+
+		// count, prefix sum, fill
+		cell_start.assign(nx*ny + 1, 0);
+		for(int pass = 0; pass<2; ++pass){
+			vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+			for(int i = 0; i<(int)polys.size(); ++i){
+				for(int cy = cell_y(box[4*i + 1]); cy <= cell_y(box[4*i + 3]); ++cy){
+					for(int cx = cell_x(box[4*i]); cx <= cell_x(box[4*i + 2]); ++cx){
+						if(pass == 0){
+							cell_start[cy*nx + cx + 1]++;
+						}
+						else {
+							cell_items[fill[cy*nx + cx]++] = i;
+						}
+					}
+				}
+			}
+			if(pass == 0){
+				for(int c = 0; c<nx*ny; ++c){
+					cell_start[c + 1] += cell_start[c];
+				}
+				cell_items.assign(cell_start.back(), 0);
+			}
+		}
+	}
+
+	// footprint bounding box, all zero for a point robot
+	void footprint_box(double b[4]) const {
+		b[0] = b[1] = b[2] = b[3] = 0;
+		for(const point &p : footprint){
+			b[0] = min(b[0], p.x);
+			b[1] = min(b[1], p.y);
+			b[2] = max(b[2], p.x);
+			b[3] = max(b[3], p.y);
+		}
+	}
+
+	// true if the robot can move in a straight line from (ax, ay) to (bx, by)
+	bool edge_free(double ax, double ay, double bx, double by) const {
+		if(polys.empty()){
+			return true;
+		}
+
+		// the swept footprint is the hull of the footprint at both ends,
+		// GJK only needs the support points so the cloud is left unordered
+		static thread_local vector<point> swept;
+		swept.clear();
+		if(footprint.empty()){
+			swept.push_back(point(ax, ay));
+			swept.push_back(point(bx, by));
+		}
+		else {
+			for(const point &p : footprint){
+				swept.push_back(point(ax + p.x, ay + p.y));
+				swept.push_back(point(bx + p.x, by + p.y));
+			}
+		}
+
+		double fb[4];
+		footprint_box(fb);
+		double qb[4] = {min(ax, bx) + fb[0], min(ay, by) + fb[1], max(ax, bx) + fb[2], max(ay, by) + fb[3]};
+
+		// an obstacle spanning several cells shows up once per cell, remember the ones tested
+		static thread_local vector<int> seen;
+		seen.clear();
+
+		for(int cy = cell_y(qb[1]); cy <= cell_y(qb[3]); ++cy){
+			for(int cx = cell_x(qb[0]); cx <= cell_x(qb[2]); ++cx){
+				for(int k = cell_start[cy*nx + cx]; k<cell_start[cy*nx + cx + 1]; ++k){
+					int i = cell_items[k];
+					const double *b = &box[4*i];
+					if(b[0] > qb[2] || b[2] < qb[0] || b[1] > qb[3] || b[3] < qb[1]){
+						continue;
+					}
+					if(find(seen.begin(), seen.end(), i) != seen.end()){
+						continue;
+					}
+					seen.push_back(i);
+					__atomic_fetch_add(&narrow_calls, 1, __ATOMIC_RELAXED);
+					if(intersects(swept, polys[i])){
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool point_free(double x, double y) const {
+		return edge_free(x, y, x, y);
+	}
+};
+
+
+// n random convex obstacles (jittered regular polygons) inside the given bounds
+obstacle_map random_obstacles(int n, double xlb, double xub, double ylb, double yub, uint64_t seed){
+	obstacle_map map;
+	mt19937_64 rng(seed);
+	uniform_real_distribution<double> unit(0.0, 1.0);
+	for(int i = 0; i<n; ++i){
+		double cx = xlb + unit(rng)*(xub - xlb);
+		double cy = ylb + unit(rng)*(yub - ylb);
+		double r = 8 + unit(rng)*32;
+		int sides = 3 + (int)(unit(rng)*5);
+		double phase = unit(rng)*2*M_PI;
+		vector<point> poly;
+		for(int k = 0; k<sides; ++k){
+			double a = phase + 2*M_PI*(k + 0.3*unit(rng))/sides;
+			poly.push_back(point(cx + r*cos(a), cy + r*sin(a)));
+		}
+		map.add(poly);
+	}
+	map.build(xlb, xub, ylb, yub, 32);
+	return map;
+}
+
+
+// rasterized view of an obstacle_map: per cell a truncated signed distance to the
+// nearest obstacle (negative inside) plus two bit planes, occupied and boundary
+//
+// a cell is occupied when it is certainly in collision (its centre is deeper inside
+// than the half diagonal), free when the footprint can sit anywhere in it, and boundary
+// otherwise. only boundary answers fall through to the exact GJK test. an edge is known
+// free without GJK when it stays inside the clear disc around either endpoint
+//
+// cells are stored in 8x8 tiles, one uint64 per tile and plane and 64 contiguous
+// distances, so a query touches one or two cache lines. tiles are built in parallel
+// and rebuild_region only redoes the tiles a moved obstacle can have affected
+// (the footprint is assumed to cover its reference point)
+
+enum : int { CELL_FREE, CELL_OCCUPIED, CELL_BOUNDARY };
+
+struct occupancy_grid {
+
+	static const int TILE = 8;
+
+	const obstacle_map *map = nullptr;
+	double x0 = 0, y0 = 0, cell = 4;
+	int nx = 0, ny = 0, tx = 0, ty = 0;
+
+	// distances are clamped to +-max_dist, footprint reach is added to every free test
+	double max_dist = 64;
+	double reach = 0;
+
+	vector<float> sdf;
+	vector<uint64_t> occupied_bits;
+	vector<uint64_t> boundary_bits;
+
+	// tile index * 64 + slot inside the tile
+	int slot(int cx, int cy) const {
+		return ((cy >> 3)*tx + (cx >> 3))*64 + (cy & 7)*TILE + (cx & 7);
+	}
+
+	bool cell_of(double x, double y, int &cx, int &cy) const {
+		cx = (int)floor((x - x0)/cell);
+		cy = (int)floor((y - y0)/cell);
+		return cx >= 0 && cy >= 0 && cx < nx && cy < ny;
+	}
+
+	int classify_point(double x, double y) const {
+		int cx, cy;
+		if(!cell_of(x, y, cx, cy)){
+			return CELL_BOUNDARY;
+		}
+		int s = slot(cx, cy);
+		if(occupied_bits[s >> 6] >> (s & 63) & 1){
+			return CELL_OCCUPIED;
+		}
+		return boundary_bits[s >> 6] >> (s & 63) & 1 ? CELL_BOUNDARY : CELL_FREE;
+	}
+
+	bool occupied(double x, double y) const {
+		return classify_point(x, y) == CELL_OCCUPIED;
+	}
+
+	// guaranteed clearance of the footprint anywhere around (x, y), negative if unknown
+	double clearance(double x, double y) const {
+		int cx, cy;
+		if(!cell_of(x, y, cx, cy)){
+			return -1;
+		}
+		double cxc = x0 + (cx + 0.5)*cell, cyc = y0 + (cy + 0.5)*cell;
+		return sdf[slot(cx, cy)] - hypot(x - cxc, y - cyc) - reach;
+	}
+
+	// true when a point of the segment lies in an occupied cell, sampled every half cell
+	// so it cannot step over a cell. false says nothing, the segment may still hit
+	bool crosses_occupied(double ax, double ay, double bx, double by) const {
+		int steps = (int)(2*hypot(bx - ax, by - ay)/cell) + 1;
+		for(int k = 0; k<=steps; ++k){
+			double t = (double)k/steps;
+			if(occupied(ax + (bx - ax)*t, ay + (by - ay)*t)){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int classify_edge(double ax, double ay, double bx, double by) const {
+		if(occupied(ax, ay) || occupied(bx, by)){
+			return CELL_OCCUPIED;
+		}
+		double len = hypot(bx - ax, by - ay);
+		if(clearance(ax, ay) > len || clearance(bx, by) > len){
+			return CELL_FREE;
+		}
+		return CELL_BOUNDARY;
+	}
+
+	// signed distance from (x, y) to a convex polygon given in either winding
+	static double signed_dist(const vector<point> &poly, double x, double y){
+		int n = poly.size();
+		double best = INFINITY;
+		int pos = 0, neg = 0;
+		for(int i = 0; i<n; ++i){
+			const point &a = poly[i], &b = poly[modinc(i, n)];
+			double ex = b.x - a.x, ey = b.y - a.y;
+			double px = x - a.x, py = y - a.y;
+			double l2 = ex*ex + ey*ey;
+			double t = l2 > 0 ? min(max((px*ex + py*ey)/l2, 0.0), 1.0) : 0;
+			best = min(best, hypot(px - t*ex, py - t*ey));
+			double c = ex*py - ey*px;
+			pos += c > 0;
+			neg += c < 0;
+		}
+		return (n > 2 && (pos == 0 || neg == 0)) ? -best : best;
+	}
+
+	void build_tile(int t, vector<int> &cand){
+		int tcx = (t % tx)*TILE, tcy = (t / tx)*TILE;
+		double bx0 = x0 + tcx*cell - max_dist, by0 = y0 + tcy*cell - max_dist;
+		double bx1 = x0 + (tcx + TILE)*cell + max_dist, by1 = y0 + (tcy + TILE)*cell + max_dist;
+
+		// obstacles whose box comes within max_dist of the tile
+		cand.clear();
+		for(int cy = map->cell_y(by0); cy <= map->cell_y(by1); ++cy){
+			for(int cx = map->cell_x(bx0); cx <= map->cell_x(bx1); ++cx){
+				int c = cy*map->nx + cx;
+				for(int k = map->cell_start[c]; k<map->cell_start[c + 1]; ++k){
+					const double *b = &map->box[4*map->cell_items[k]];
+					if(b[0] <= bx1 && b[2] >= bx0 && b[1] <= by1 && b[3] >= by0){
+						cand.push_back(map->cell_items[k]);
+					}
+				}
+			}
+		}
+		sort(cand.begin(), cand.end());
+		cand.erase(unique(cand.begin(), cand.end()), cand.end());
+
+		double half_diag = cell*M_SQRT1_2;
+		uint64_t occ = 0, bnd = 0;
+		for(int k = 0; k<64; ++k){
+			int cx = tcx + (k & 7), cy = tcy + (k >> 3);
+			double d = max_dist;
+			if(cx < nx && cy < ny){
+				double x = x0 + (cx + 0.5)*cell, y = y0 + (cy + 0.5)*cell;
+				for(int i : cand){
+					d = min(d, signed_dist(map->polys[i], x, y));
+				}
+				d = max(d, -max_dist);
+			}
+			sdf[64*t + k] = d;
+			if(d < -half_diag){
+				occ |= 1ULL << k;
+			}
+			else if(d <= half_diag + reach){
+				bnd |= 1ULL << k;
+			}
+		}
+		occupied_bits[t] = occ;
+		boundary_bits[t] = bnd;
+	}
+
+	// builds the tiles in [t0, t1] x [u0, u1] on the given number of threads
+	void build_tiles(int t0, int t1, int u0, int u1, int threads){
+		vector<int> tiles;
+		for(int u = u0; u<=u1; ++u){
+			for(int t = t0; t<=t1; ++t){
+				tiles.push_back(u*tx + t);
+			}
+		}
+		atomic<int> next(0);
+		auto worker = [&](){
+			vector<int> cand;
+			for(int k = next++; k<(int)tiles.size(); k = next++){
+				build_tile(tiles[k], cand);
+			}
+		};
+		vector<thread> pool;
+		for(int i = 1; i<threads; ++i){
+			pool.emplace_back(worker);
+		}
+		worker();
+		for(thread &th : pool){
+			th.join();
+		}
+	}
+
+	void build(const obstacle_map &m, double xlb, double xub, double ylb, double yub, double cell_size, int threads = 0){
+		map = &m;
+		x0 = xlb;
+		y0 = ylb;
+		cell = cell_size;
+		nx = max(1, (int)ceil((xub - xlb)/cell));
+		ny = max(1, (int)ceil((yub - ylb)/cell));
+		tx = (nx + TILE - 1)/TILE;
+		ty = (ny + TILE - 1)/TILE;
+
+		reach = 0;
+		for(const point &p : m.footprint){
+			reach = max(reach, hypot(p.x, p.y));
+		}
+
+		sdf.assign(64*tx*ty, max_dist);
+		occupied_bits.assign(tx*ty, 0);
+		boundary_bits.assign(tx*ty, 0);
+
+		if(threads <= 0){
+			threads = max(1u, thread::hardware_concurrency());
+		}
+		build_tiles(0, tx - 1, 0, ty - 1, threads);
+	}
+
+	// call after obstacles inside [xmin, xmax] x [ymin, ymax] were added, moved or
+	// removed (pass the union of old and new boxes). only tiles within max_dist
+	// of that box can see a different distance
+	void rebuild_region(double xmin, double ymin, double xmax, double ymax, int threads = 1){
+		int t0 = max(0, (int)floor((xmin - max_dist - x0)/cell) / TILE);
+		int t1 = min(tx - 1, (int)floor((xmax + max_dist - x0)/cell) / TILE);
+		int u0 = max(0, (int)floor((ymin - max_dist - y0)/cell) / TILE);
+		int u1 = min(ty - 1, (int)floor((ymax + max_dist - y0)/cell) / TILE);
+		if(t0 <= t1 && u0 <= u1){
+			build_tiles(t0, t1, u0, u1, threads);
+		}
+	}
+};
+
+
+// append-only binary log of tree changes
+//
+// 16 byte header : "RRTL", u32 version, u32 record size, u32 reserved
+// then 16 byte little endian records { i32 id, i32 parent, f32 x, f32 y } meaning
+// "node id sits at (x, y) and now hangs under parent". the same id shows up again when
+// RRT* rewires it or lazy repair moves it, and parent -1 on a non-root means the node
+// was cut off. records are buffered and written in blocks, so a reader tailing the
+// file only ever has to hold back a partial record at the end
+
+#define TREE_LOG_VERSION 1
+
+struct log_record {
+	int32_t id;
+	int32_t parent;
+	float x;
+	float y;
+};
+
+struct tree_log {
+
+	FILE *f = nullptr;
+	vector<log_record> buf;
+	size_t flush_at = 4096;
+
+	bool open(const char *path){
+		f = fopen(path, "wb");
+		if(!f){
+			return false;
+		}
+		uint32_t header[4] = {0, TREE_LOG_VERSION, sizeof(log_record), 0};
+		memcpy(header, "RRTL", 4);
+		fwrite(header, sizeof(header), 1, f);
+		fflush(f);
+		buf.reserve(flush_at);
+		return true;
+	}
+
+	void record(int id, int parent, double x, double y){
+		buf.push_back({id, parent, (float)x, (float)y});
+		if(buf.size() >= flush_at){
+			flush();
+		}
+	}
+
+	void flush(){
+		if(f && !buf.empty()){
+			fwrite(buf.data(), sizeof(log_record), buf.size(), f);
+			fflush(f);
+		}
+		buf.clear();
+	}
+
+	void close(){
+		flush();
+		if(f){
+			fclose(f);
+			f = nullptr;
+		}
+	}
+
+	~tree_log(){ close(); }
+};
+
+
+// sample sources for the planner
+enum sample_mode { SAMPLE_UNIFORM, SAMPLE_HALTON, SAMPLE_SOBOL };
+
+static inline uint64_t splitmix64(uint64_t z){
+	z += 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint32_t reverse_bits(uint32_t v){
+	v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+	v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+	v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+	v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+
+// generates samples a block at a time into flat x / y arrays and hands them out one by one
+// every mode is indexed by a running sample counter, so the inner loops are plain
+// arithmetic over the block. streams with different ids draw different points:
+//   uniform : counter based splitmix64 hash of (seed, index), the stream id is the top
+//             32 bits of the counter
+//   halton  : bases 2 and 3 with a Cranley-Patterson rotation seeded by (seed, stream)
+//   sobol   : first two sobol dimensions with a digital shift seeded by (seed, stream)
+// halton and sobol only use the low 32 bits of the counter, so each of their streams is
+// the same low discrepancy sequence moved somewhere else in the window
+// goal_bias replaces that fraction of the samples with the goal itself, and samples
+// landing in an occupied cell of the occupancy grid are compacted out of the block
+
+struct sampler {
+
+	static const int BLOCK = 256;
+
+	int mode = SAMPLE_UNIFORM;
+	double xlb = 0, xw = 800, ylb = 0, yw = 600;
+	double goal_bias = 0, goal_x = 0, goal_y = 0;
+	uint64_t seed = 0;
+	uint64_t index = 0;
+
+	// halton rotation / sobol shift
+	double rot_x = 0, rot_y = 0;
+	uint32_t shift_x = 0, shift_y = 0;
+
+	// sobol state for index, advanced in gray code order
+	uint32_t sobol_v[2][32];
+	uint32_t sobol_x = 0, sobol_y = 0;
+
+	const occupancy_grid *occ = nullptr;
+
+	double xs[BLOCK], ys[BLOCK];
+	int head = 0, count = 0;
+
+	sampler() {}
+
+	sampler(int mode, double xlb, double xub, double ylb, double yub, uint64_t seed, uint64_t stream)
+		: mode(mode), xlb(xlb), xw(xub - xlb), ylb(ylb), yw(yub - ylb), seed(seed) {
+		index = stream << 32;
+		// stream 0 keeps the plain seeded rotation
+		uint64_t h = splitmix64(seed ^ 0x5851f42d4c957f2dULL ^ stream*0x9e3779b97f4a7c15ULL);
+		rot_x = (h >> 11)*0x1.0p-53;
+		h = splitmix64(h);
+		rot_y = (h >> 11)*0x1.0p-53;
+		shift_x = (uint32_t)h;
+		shift_y = (uint32_t)(h >> 32);
+
+		// dimension 1 is van der corput, dimension 2 comes from the polynomial x + 1
+		for(int k = 0; k<32; ++k){
+			sobol_v[0][k] = 1u << (31 - k);
+			sobol_v[1][k] = k ? sobol_v[1][k - 1] ^ (sobol_v[1][k - 1] >> 1) : 1u << 31;
+		}
+		uint32_t g = (uint32_t)index ^ ((uint32_t)index >> 1);
+		for(int k = 0; k<32; ++k){
+			if(g >> k & 1){
+				sobol_x ^= sobol_v[0][k];
+				sobol_y ^= sobol_v[1][k];
+			}
+		}
+	}
+
+	void set_goal(double x, double y, double bias){
+		goal_x = x;
+		goal_y = y;
+		goal_bias = bias;
+	}
+
+	void next(double &x, double &y){
+		// a map that is occupied everywhere would spin forever, give up on rejection then
+		for(int tries = 0; head == count; ++tries){
+			refill(tries < 64);
+		}
+		x = xs[head];
+		y = ys[head];
+		head++;
+	}
+
+	void refill(bool reject){
+		uint64_t base = index;
+		index += BLOCK;
+
+		switch(mode)
+		{
+			case SAMPLE_UNIFORM:
+			for(int i = 0; i<BLOCK; ++i){
+				uint64_t k = seed ^ (base + i)*0x2545f4914f6cdd1dULL;
+				xs[i] = (splitmix64(k) >> 11)*0x1.0p-53;
+				ys[i] = (splitmix64(k ^ 0xd1b54a32d192ed03ULL) >> 11)*0x1.0p-53;
+			}
+			break;
+
+			case SAMPLE_HALTON:
+			for(int i = 0; i<BLOCK; ++i){
+				uint32_t n = (uint32_t)(base + i);
+				double u = reverse_bits(n)*0x1.0p-32 + rot_x;
+				double v = 0, f = 1.0/3;
+				for(uint32_t m = n; m; m /= 3, f /= 3){
+					v += (m % 3)*f;
+				}
+				v += rot_y;
+				xs[i] = u - (u >= 1);
+				ys[i] = v - (v >= 1);
+			}
+			break;
+
+			case SAMPLE_SOBOL:
+			for(int i = 0; i<BLOCK; ++i){
+				xs[i] = (sobol_x ^ shift_x)*0x1.0p-32;
+				ys[i] = (sobol_y ^ shift_y)*0x1.0p-32;
+				int c = __builtin_ctz((uint32_t)(base + i + 1) | 0x80000000u);
+				sobol_x ^= sobol_v[0][c];
+				sobol_y ^= sobol_v[1][c];
+			}
+			break;
+		}
+
+		for(int i = 0; i<BLOCK; ++i){
+			xs[i] = xlb + xs[i]*xw;
+			ys[i] = ylb + ys[i]*yw;
+		}
+
+		if(goal_bias > 0){
+			uint64_t cut = (uint64_t)(goal_bias*0x1.0p64 > 0x1.0p64 - 1 ? UINT64_MAX : goal_bias*0x1.0p64);
+			for(int i = 0; i<BLOCK; ++i){
+				bool g = splitmix64(seed ^ ~(base + i)) < cut;
+				xs[i] = g ? goal_x : xs[i];
+				ys[i] = g ? goal_y : ys[i];
+			}
+		}
+
+		// keep every sample outside the bitmap, in order
+		count = BLOCK;
+		if(occ && reject){
+			count = 0;
+			for(int i = 0; i<BLOCK; ++i){
+				xs[count] = xs[i];
+				ys[count] = ys[i];
+				count += !occ->occupied(xs[i], ys[i]) || (xs[i] == goal_x && ys[i] == goal_y);
+			}
+		}
+		head = 0;
+	}
+};
+
+
+struct rrt_params {
+	// sampling bounds, same as sample_point(800, 0, 600, 0) in rrt_viz.py
+	double xlb = 0, xub = 800;
+	double ylb = 0, yub = 600;
+
+	double root_x = 400, root_y = 300;
+
+	// mindist is carried along like in enforce_dist_limits but not enforced there either
+	double mindist = 10;
+	double maxdist = 20;
+
+	uint64_t seed = 0;
+
+	// RRT* : neighbourhood radius is min(gamma*sqrt(log(n)/n), maxdist)
+	// the default gamma is the usual 2*sqrt(1.5*area/pi) bound for the 800x600 window
+	bool star = false;
+	double gamma = 957;
+
+	// only meaningful with obstacles, see the header
+	bool lazy = false;
+
+	// goal region, a disc around (goal_x, goal_y)
+	bool has_goal = false;
+	double goal_x = 0, goal_y = 0;
+	double goal_radius = 10;
+
+	// see sampler, goal_bias only applies with a goal
+	int sample_mode = SAMPLE_UNIFORM;
+	double goal_bias = 0;
+};
+
+
+// time spent in the two hot queries, filled in when rrt::stats is set
+// only sequential growth is timed, grow_parallel workers run untimed
+struct rrt_stats {
+	long long nearest_calls = 0;
+	long long edge_checks = 0;
+	double nearest_secs = 0;
+	double edge_secs = 0;
+};
+
+
+// state of the edge from a node to its parent
+enum : unsigned char { EDGE_UNKNOWN, EDGE_VALID };
+
+// GJK checks a lazy repair spends on one cut off node before leaving it dead
+#define REPAIR_CHECKS 2
+
+
+struct rrt {
+
+	rrt_params prm;
+
+	// node i is at (xy[2i], xy[2i+1]), its parent is parent[i] (-1 for the root)
+	// children are an intrusive singly linked list: first_child / next_sibling
+	// cost[i] is the path length from the root to node i
+	// edge_state[i] is what is known about the edge parent[i] -> i
+	// alive[i] is cleared when a lazy check cuts the node off from the root
+	vector<double> xy;
+	vector<int> parent;
+	vector<int> first_child;
+	vector<int> next_sibling;
+	vector<double> cost;
+	vector<unsigned char> edge_state;
+	vector<unsigned char> alive;
+
+	// node pairs whose connecting edge failed a collision check
+	unordered_set<uint64_t> bad_edges;
+
+	// nodes that landed in the goal region, dead ones are dropped lazily
+	vector<int> goal_nodes;
+
+	kd_tree index;
+
+	// optional, everything is free space without it
+	const obstacle_map *obstacles = nullptr;
+
+	// optional rasterized obstacles, must be built from the same map
+	const occupancy_grid *field = nullptr;
+
+	// optional change log, ids are written shifted by log_base so several trees
+	// can share one file
+	tree_log *change_log = nullptr;
+	int log_base = 0;
+
+	// optional query timers, costs two clock reads per query while attached
+	rrt_stats *stats = nullptr;
+
+	// bumped per grow_parallel call so every worker gets a fresh sample stream
+	int parallel_runs = 0;
+
+	// scratch buffers reused between steps
+	vector<int> near_buf;
+	vector<int> stack_buf;
+
+	sampler smp;
+
+	// sampler for the given stream, streams never repeat each other's samples
+	sampler make_sampler(uint64_t stream) const {
+		sampler s(prm.sample_mode, prm.xlb, prm.xub, prm.ylb, prm.yub, prm.seed, stream);
+		if(prm.has_goal){
+			s.set_goal(prm.goal_x, prm.goal_y, prm.goal_bias);
+		}
+		s.occ = smp.occ;
+		return s;
+	}
+
+	rrt(const rrt_params &p) : prm(p) {
+		smp = make_sampler(0);
+		index.xy = &xy;
+		index.alive = &alive;
+		add_node(prm.root_x, prm.root_y, -1);
+	}
+
+	int size() const { return (int)parent.size(); }
+
+	void log_node(int id){
+		if(change_log){
+			change_log->record(id + log_base, parent[id] == -1 ? -1 : parent[id] + log_base, xy[2*id], xy[2*id + 1]);
+		}
+	}
+
+	// attaches l and writes out the nodes that already exist
+	void set_log(tree_log *l, int base = 0){
+		change_log = l;
+		log_base = base;
+		for(int id = 0; id<size(); ++id){
+			if(alive[id]){
+				log_node(id);
+			}
+		}
+	}
+
+	void reserve(int n){
+		xy.reserve(2*n);
+		parent.reserve(n);
+		first_child.reserve(n);
+		next_sibling.reserve(n);
+		cost.reserve(n);
+		edge_state.reserve(n);
+		alive.reserve(n);
+		index.left.reserve(n);
+		index.right.reserve(n);
+	}
+
+	int add_node(double x, double y, int par){
+		int id = size();
+		xy.push_back(x);
+		xy.push_back(y);
+		parent.push_back(-1);
+		first_child.push_back(-1);
+		next_sibling.push_back(-1);
+		cost.push_back(0);
+		edge_state.push_back(prm.lazy ? EDGE_UNKNOWN : EDGE_VALID);
+		alive.push_back(1);
+		if(par != -1){
+			add_child(par, id);
+			cost[id] = cost[par] + dist(par, id);
+		}
+		else {
+			edge_state[id] = EDGE_VALID;
+		}
+		index.insert(id);
+		if(prm.has_goal && in_goal(id)){
+			goal_nodes.push_back(id);
+		}
+		return id;
+	}
+
+	bool in_goal(int id) const {
+		return dist(id, prm.goal_x, prm.goal_y) <= prm.goal_radius;
+	}
+
+	void add_child(int p, int c){
+		parent[c] = p;
+		next_sibling[c] = first_child[p];
+		first_child[p] = c;
+		log_node(c);
+	}
+
+	void remove_child(int p, int c){
+		int *link = &first_child[p];
+		while(*link != c){
+			link = &next_sibling[*link];
+		}
+		*link = next_sibling[c];
+		next_sibling[c] = -1;
+		parent[c] = -1;
+	}
+
+	double dist(int a, int b) const {
+		return hypot(xy[2*a] - xy[2*b], xy[2*a + 1] - xy[2*b + 1]);
+	}
+
+	double dist(int a, double x, double y) const {
+		return hypot(xy[2*a] - x, xy[2*a + 1] - y);
+	}
+
+	// adds delta to the cost of every node below (and including) id
+	void propagate_cost(int id, double delta){
+		stack_buf.clear();
+		stack_buf.push_back(id);
+		while(!stack_buf.empty()){
+			int n = stack_buf.back();
+			stack_buf.pop_back();
+			cost[n] += delta;
+			for(int c = first_child[n]; c != -1; c = next_sibling[c]){
+				stack_buf.push_back(c);
+			}
+		}
+	}
+
+	// moves node c (and its subtree) under p, c ends up with cost new_cost
+	void rewire(int c, int p, double new_cost){
+		remove_child(parent[c], c);
+		add_child(p, c);
+		edge_state[c] = prm.lazy ? EDGE_UNKNOWN : EDGE_VALID;
+		propagate_cost(c, new_cost - cost[c]);
+	}
+
+	static uint64_t edge_key(int a, int b){
+		return a < b ? (uint64_t)a << 32 | (uint32_t)b : (uint64_t)b << 32 | (uint32_t)a;
+	}
+
+	bool known_bad(int a, int b) const {
+		return !bad_edges.empty() && bad_edges.count(edge_key(a, b));
+	}
+
+	// validates the edge parent[c] -> c, the result is cached either way
+	bool check_edge(int c){
+		if(edge_state[c] == EDGE_VALID){
+			return true;
+		}
+		if(edge_free(parent[c], xy[2*c], xy[2*c + 1])){
+			edge_state[c] = EDGE_VALID;
+			return true;
+		}
+		bad_edges.insert(edge_key(parent[c], c));
+		return false;
+	}
+
+	// cuts c and its subtree off after its parent edge failed, then walks the subtree
+	// top down and tries to hang each node that is still cut off under a live node, which
+	// brings that node's own subtree back. the candidates are the k nearest live nodes
+	// (k = 2e log n as in k-nearest RRT*), an extend step is far too short once a whole
+	// region has been cut off. they are tried cheapest first and the edge is checked right
+	// away, so a repair never goes back through the wall it came off. the grid throws out
+	// candidates whose edge runs through an occupied cell and passes those it shows free,
+	// only REPAIR_CHECKS of the rest get a GJK check. whatever finds no free edge stays
+	// dead
+	void invalidate_and_repair(int c){
+		remove_child(parent[c], c);
+
+		// subtree nodes must not be candidates, that would make a cycle
+		vector<int> sub;
+		sub.push_back(c);
+		for(int k = 0; k<(int)sub.size(); ++k){
+			alive[sub[k]] = 0;
+			for(int ch = first_child[sub[k]]; ch != -1; ch = next_sibling[ch]){
+				sub.push_back(ch);
+			}
+		}
+
+		int k = (int)ceil(2*M_E*log(size() + 1.0));
+		vector<pair<double, int>> order;
+		for(int s : sub){
+			if(alive[s]){
+				// came back with an ancestor
+				continue;
+			}
+
+			index.nearest_k(xy[2*s], xy[2*s + 1], k, near_buf);
+			order.clear();
+			for(int n : near_buf){
+				if(!known_bad(n, s)){
+					order.push_back({cost[n] + dist(n, s), n});
+				}
+			}
+			sort(order.begin(), order.end());
+
+			int best = -1;
+			int checks = REPAIR_CHECKS;
+			double best_cost = INFINITY;
+			for(auto &o : order){
+				int n = o.second;
+				int cell = field ? field->classify_edge(xy[2*n], xy[2*n + 1], xy[2*s], xy[2*s + 1]) : CELL_BOUNDARY;
+				if(cell == CELL_BOUNDARY && field && field->crosses_occupied(xy[2*n], xy[2*n + 1], xy[2*s], xy[2*s + 1])){
+					cell = CELL_OCCUPIED;
+				}
+				if(cell == CELL_BOUNDARY && obstacles && checks-- == 0){
+					break;
+				}
+				if(cell != CELL_OCCUPIED && edge_free(n, xy[2*s], xy[2*s + 1])){
+					best = n;
+					best_cost = o.first;
+					break;
+				}
+				bad_edges.insert(edge_key(n, s));
+			}
+			if(best == -1){
+				continue;
+			}
+
+			if(parent[s] != -1){
+				remove_child(parent[s], s);
+			}
+			add_child(best, s);
+			edge_state[s] = EDGE_VALID;
+
+			// revive and re-cost the subtree in one walk
+			double delta = best_cost - cost[s];
+			stack_buf.clear();
+			stack_buf.push_back(s);
+			while(!stack_buf.empty()){
+				int n = stack_buf.back();
+				stack_buf.pop_back();
+				alive[n] = 1;
+				cost[n] += delta;
+				for(int ch = first_child[n]; ch != -1; ch = next_sibling[ch]){
+					stack_buf.push_back(ch);
+				}
+			}
+		}
+
+		if(change_log){
+			for(int s : sub){
+				if(!alive[s]){
+					change_log->record(s + log_base, -1, xy[2*s], xy[2*s + 1]);
+				}
+			}
+		}
+	}
+
+	// cheapest live node in the goal region whose path back to the root is collision free,
+	// -1 if there is none yet. in lazy mode this is where the collision checks happen:
+	// unknown edges on the candidate path are checked root first and the first failure
+	// is repaired before moving on to the next candidate
+	int solution(){
+		while(true){
+			int best = -1;
+			int live = 0;
+			for(int g : goal_nodes){
+				if(!alive[g]){
+					continue;
+				}
+				goal_nodes[live++] = g;
+				if(best == -1 || cost[g] < cost[best]){
+					best = g;
+				}
+			}
+			goal_nodes.resize(live);
+
+			if(best == -1 || !prm.lazy){
+				return best;
+			}
+
+			vector<int> path = path_to(best);
+			bool ok = true;
+			for(int k = 1; k<(int)path.size(); ++k){
+				if(!check_edge(path[k])){
+					invalidate_and_repair(path[k]);
+					ok = false;
+					break;
+				}
+			}
+			if(ok){
+				return best;
+			}
+		}
+	}
+
+	double star_radius() const {
+		double n = size();
+		return min(prm.gamma*sqrt(log(n + 1)/n), prm.maxdist);
+	}
+
+	bool edge_free(int a, double x, double y) const {
+		if(!obstacles){
+			return true;
+		}
+		if(stats){
+			auto t0 = chrono::steady_clock::now();
+			bool ok = check_free(a, x, y);
+			stats->edge_checks++;
+			stats->edge_secs += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+			return ok;
+		}
+		return check_free(a, x, y);
+	}
+
+	// edge_free without the stats, the parallel workers call it directly
+	bool check_free(int a, double x, double y) const {
+		if(!obstacles){
+			return true;
+		}
+		if(field){
+			int c = field->classify_edge(xy[2*a], xy[2*a + 1], x, y);
+			if(c != CELL_BOUNDARY){
+				return c == CELL_FREE;
+			}
+		}
+		return obstacles->edge_free(xy[2*a], xy[2*a + 1], x, y);
+	}
+
+	// root first
+	vector<int> path_to(int id) const {
+		vector<int> path;
+		for(; id != -1; id = parent[id]){
+			path.push_back(id);
+		}
+		return vector<int>(path.rbegin(), path.rend());
+	}
+
+	void sample_point(double &x, double &y){
+		smp.next(x, y);
+	}
+
+	int get_nearest(double x, double y, double &dist) const {
+		auto t0 = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+		int id = index.nearest(x, y, dist);
+		dist = sqrt(dist);
+		if(stats){
+			stats->nearest_calls++;
+			stats->nearest_secs += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		}
+		return id;
+	}
+
+	void get_near(double x, double y, double r, vector<int> &out) const {
+		auto t0 = stats ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+		index.near(x, y, r*r, out);
+		if(stats){
+			stats->nearest_calls++;
+			stats->nearest_secs += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		}
+	}
+
+	// clamps (x, y) to at most maxdist away from node near
+	void enforce_dist_limits(double &x, double &y, int near, double dist) const {
+		if(dist <= prm.maxdist){
+			return;
+		}
+		double nx = xy[2*near], ny = xy[2*near + 1];
+		double s = prm.maxdist/dist;
+		x = nx + (x - nx)*s;
+		y = ny + (y - ny)*s;
+	}
+
+	// plain RRT step from the nearest node towards (x, y), always checked eagerly
+	// returns the new node, or -1 when the way is blocked. reached is set when the
+	// returned node sits on (x, y) itself (which may be an existing node)
+	int extend(double x, double y, bool &reached){
+		double dist;
+		int closest = get_nearest(x, y, dist);
+		reached = dist == 0;
+		if(reached){
+			return closest;
+		}
+		enforce_dist_limits(x, y, closest, dist);
+		if(!edge_free(closest, x, y)){
+			return -1;
+		}
+		reached = dist <= prm.maxdist;
+		return add_node(x, y, closest);
+	}
+
+	// one step of grow_rrt()
+	// returns the index of the new node (its parent is parent[id]) or -1 if the sample
+	// landed exactly on an existing node or the extension hit an obstacle
+	int grow(){
+		double x, y, dist;
+		sample_point(x, y);
+		int closest = get_nearest(x, y, dist);
+		if(dist == 0){
+			return -1;
+		}
+		enforce_dist_limits(x, y, closest, dist);
+		if(!prm.lazy && !edge_free(closest, x, y)){
+			return -1;
+		}
+		// lazy only defers the checks that need GJK, an edge with an endpoint in an occupied
+		// cell is dropped as in eager mode since the grid answers that for free
+		if(prm.lazy && field && field->classify_edge(xy[2*closest], xy[2*closest + 1], x, y) == CELL_OCCUPIED){
+			return -1;
+		}
+		if(!prm.star){
+			return add_node(x, y, closest);
+		}
+
+		// choose the cheapest parent in the neighbourhood
+		double r = star_radius();
+		near_buf.clear();
+		get_near(x, y, r, near_buf);
+
+		int best = closest;
+		double best_cost = cost[closest] + this->dist(closest, x, y);
+		for(int n : near_buf){
+			double c = cost[n] + this->dist(n, x, y);
+			if(c < best_cost && (prm.lazy || edge_free(n, x, y))){
+				best = n;
+				best_cost = c;
+			}
+		}
+
+		int id = add_node(x, y, best);
+
+		// rewire the neighbourhood through the new node
+		// an ancestor of id can never pass this test since its cost is already lower
+		for(int n : near_buf){
+			if(n == best){
+				continue;
+			}
+			double c = best_cost + this->dist(id, n);
+			if(c < cost[n] - 1e-9 && (prm.lazy || edge_free(id, xy[2*n], xy[2*n + 1]))){
+				rewire(n, id, c);
+			}
+		}
+		return id;
+	}
+
+	// grows the tree to n nodes on the given number of threads
+	// only plain eager RRT runs in parallel, RRT* rewiring and lazy repair move nodes
+	// around and need the tree to themselves, so those modes just grow sequentially here
+	// returns the number of extension attempts
+	long long grow_parallel(int n, int threads){
+		int start = size();
+		if(n <= start){
+			return 0;
+		}
+		if(prm.star || prm.lazy || threads <= 1){
+			long long it = 0;
+			for(; size() < n && it < 100LL*(n - start); ++it){
+				grow();
+			}
+			return it;
+		}
+
+		// nothing may reallocate once the workers are running
+		xy.resize(2*n);
+		parent.resize(n, -1);
+		first_child.resize(n, -1);
+		next_sibling.resize(n, -1);
+		cost.resize(n, 0);
+		edge_state.resize(n, EDGE_VALID);
+		alive.resize(n, 1);
+		index.left.resize(n, -1);
+		index.right.resize(n, -1);
+
+		atomic<int> next_slot(start);
+		const long long attempts = 100LL*(n - start);
+		atomic<long long> budget(attempts);
+		parallel_runs++;
+
+		auto worker = [&](int tid){
+			sampler g = make_sampler((uint64_t)parallel_runs << 16 | (tid + 1));
+			double x, y, d2;
+			while(budget.fetch_sub(1, memory_order_relaxed) > 0){
+				g.next(x, y);
+				int closest = index.nearest(x, y, d2);
+				if(d2 == 0){
+					continue;
+				}
+				enforce_dist_limits(x, y, closest, sqrt(d2));
+				if(!check_free(closest, x, y)){
+					continue;
+				}
+
+				int id = next_slot.fetch_add(1, memory_order_relaxed);
+				if(id >= n){
+					return;
+				}
+
+				// fill the slot, nobody can reach it yet
+				xy[2*id] = x;
+				xy[2*id + 1] = y;
+				parent[id] = closest;
+				cost[id] = cost[closest] + dist(closest, id);
+
+				// publish: parent's child list, then the kd-tree
+				int head = __atomic_load_n(&first_child[closest], __ATOMIC_RELAXED);
+				do {
+					next_sibling[id] = head;
+				} while(!__atomic_compare_exchange_n(&first_child[closest], &head, id, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+				index.insert_concurrent(id);
+			}
+		};
+
+		vector<thread> pool;
+		for(int t = 0; t<threads; ++t){
+			pool.emplace_back(worker, t);
+		}
+		for(thread &t : pool){
+			t.join();
+		}
+
+		// slots are only claimed for finished extensions, so everything below the
+		// counter is filled in. drop the rest if the attempt budget ran out first
+		int end = min(next_slot.load(), n);
+		xy.resize(2*end);
+		parent.resize(end);
+		first_child.resize(end);
+		next_sibling.resize(end);
+		cost.resize(end);
+		edge_state.resize(end);
+		alive.resize(end);
+		index.left.resize(end);
+		index.right.resize(end);
+
+		// the workers do not touch the log, write the new nodes out in id order
+		for(int id = start; id<end; ++id){
+			log_node(id);
+		}
+
+		if(prm.has_goal){
+			for(int id = start; id<end; ++id){
+				if(in_goal(id)){
+					goal_nodes.push_back(id);
+				}
+			}
+		}
+		// every fetch_sub that still saw budget was an attempt
+		return attempts - max(budget.load(), 0LL);
+	}
+};
+
+
+// RRT-Connect between prm.root and prm.goal
+// both trees are plain RRT with eager checks, the star and lazy flags are ignored
+
+struct rrt_connect {
+
+	rrt from_start;
+	rrt from_goal;
+
+	// filled in by solve, start to goal
+	vector<point> path;
+	double path_cost = INFINITY;
+	long long iterations = 0;
+
+	static rrt_params goal_rooted(rrt_params p){
+		swap(p.root_x, p.goal_x);
+		swap(p.root_y, p.goal_y);
+		p.seed ^= 0x9e3779b97f4a7c15ULL;
+		return p;
+	}
+
+	static rrt_params eager(rrt_params p){
+		p.star = false;
+		p.lazy = false;
+		return p;
+	}
+
+	rrt_connect(const rrt_params &p, const obstacle_map *obstacles)
+		: from_start(eager(p)), from_goal(eager(goal_rooted(p))) {
+		from_start.obstacles = obstacles;
+		from_goal.obstacles = obstacles;
+	}
+
+	// goal tree ids are offset so both trees fit in one log
+	void set_log(tree_log *l){
+		from_start.set_log(l);
+		from_goal.set_log(l, 1<<30);
+	}
+
+	// keeps extending t towards (x, y) until it gets there or is blocked
+	int connect(rrt &t, double x, double y, bool &reached){
+		int last = -1;
+		while(true){
+			int id = t.extend(x, y, reached);
+			if(id == -1){
+				return last;
+			}
+			last = id;
+			if(reached){
+				return last;
+			}
+		}
+	}
+
+	// returns true once the trees meet within max_iter iterations
+	bool solve(long long max_iter){
+		// a blocked root can never grow, no point sampling
+		const obstacle_map *obs = from_start.obstacles;
+		if(obs && (!obs->point_free(from_start.prm.root_x, from_start.prm.root_y) ||
+				!obs->point_free(from_goal.prm.root_x, from_goal.prm.root_y))){
+			return false;
+		}
+
+		rrt *a = &from_start, *b = &from_goal;
+		bool reached;
+		double x, y;
+		for(; iterations < max_iter; ++iterations){
+			from_start.sample_point(x, y);
+			int ia = a->extend(x, y, reached);
+			if(ia != -1){
+				double nx = a->xy[2*ia], ny = a->xy[2*ia + 1];
+				int ib = connect(*b, nx, ny, reached);
+				if(reached){
+					build_path(a == &from_start ? ia : ib, a == &from_start ? ib : ia);
+					iterations++;
+					return true;
+				}
+			}
+			swap(a, b);
+		}
+		return false;
+	}
+
+	// is and ig are the meeting nodes, they sit on the same spot
+	void build_path(int is, int ig){
+		path.clear();
+		for(int id : from_start.path_to(is)){
+			path.push_back(point(from_start.xy[2*id], from_start.xy[2*id + 1]));
+		}
+		vector<int> back = from_goal.path_to(ig);
+		for(int k = (int)back.size() - 2; k>=0; --k){
+			path.push_back(point(from_goal.xy[2*back[k]], from_goal.xy[2*back[k] + 1]));
+		}
+		path_cost = from_start.cost[is] + from_goal.cost[ig];
+	}
+};
+
+
+#ifndef RRT_NO_MAIN
+
+int main(int argc, char **argv){
+
+	int n = 100000;
+	int clutter = 0;
+	int threads = 1;
+	bool connect = false;
+	const char *log_path = nullptr;
+	rrt_params prm;
+
+	int pos = 0;
+	for(int i = 1; i<argc; ++i){
+		if(!strcmp(argv[i], "--star")){
+			prm.star = true;
+		}
+		else if(!strcmp(argv[i], "--lazy")){
+			prm.lazy = true;
+		}
+		else if(!strcmp(argv[i], "--clutter") && i + 1 < argc){
+			clutter = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--log") && i + 1 < argc){
+			log_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--connect")){
+			connect = true;
+		}
+		else if(!strcmp(argv[i], "--threads") && i + 1 < argc){
+			threads = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--sampler") && i + 1 < argc){
+			++i;
+			prm.sample_mode = !strcmp(argv[i], "halton") ? SAMPLE_HALTON : !strcmp(argv[i], "sobol") ? SAMPLE_SOBOL : SAMPLE_UNIFORM;
+		}
+		else if(!strcmp(argv[i], "--goal-bias") && i + 1 < argc){
+			prm.goal_bias = atof(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--goal") && i + 2 < argc){
+			prm.has_goal = true;
+			prm.goal_x = atof(argv[++i]);
+			prm.goal_y = atof(argv[++i]);
+		}
+		else if(pos++ == 0){
+			n = atoi(argv[i]);
+		}
+		else {
+			prm.seed = strtoull(argv[i], nullptr, 10);
+		}
+	}
+
+	obstacle_map map = random_obstacles(clutter, prm.xlb, prm.xub, prm.ylb, prm.yub, prm.seed + 1);
+	occupancy_grid occ;
+	if(clutter){
+		occ.build(map, prm.xlb, prm.xub, prm.ylb, prm.yub, 4);
+	}
+
+	tree_log log;
+	if(log_path && !log.open(log_path)){
+		cout << "Error opening " << log_path << endl;
+		return -1;
+	}
+
+	if(connect){
+		if(!prm.has_goal){
+			cout << "--connect needs --goal x y" << endl;
+			return -1;
+		}
+		rrt_connect rc(prm, clutter ? &map : nullptr);
+		if(clutter){
+			rc.from_start.smp.occ = &occ;
+			rc.from_start.field = &occ;
+			rc.from_goal.field = &occ;
+		}
+		if(log_path){
+			rc.set_log(&log);
+		}
+		auto t0 = chrono::steady_clock::now();
+		bool met = rc.solve(n);
+		double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+		cout << rc.iterations << " iterations, " << rc.from_start.size() + rc.from_goal.size()
+			<< " nodes in " << secs << " s" << endl;
+		if(met){
+			cout << "path cost " << rc.path_cost << " (" << rc.path.size() << " nodes)" << endl;
+		}
+		else {
+			cout << "trees did not meet" << endl;
+		}
+		return 0;
+	}
+
+	rrt tree(prm);
+	tree.reserve(n);
+	if(clutter){
+		tree.obstacles = &map;
+		tree.smp.occ = &occ;
+		tree.field = &occ;
+	}
+	if(log_path){
+		tree.set_log(&log);
+	}
+
+	// the root may be boxed in, so bound the attempts
+	long long iters = 0;
+	auto t0 = chrono::steady_clock::now();
+	int sol = -1;
+	if(threads > 1){
+		iters += tree.grow_parallel(n, threads);
+	}
+	while(tree.size() < n && iters < 100LL*n){
+		int id = tree.grow();
+		iters++;
+		// a new goal node is a new candidate path
+		if(id != -1 && prm.has_goal && tree.in_goal(id)){
+			sol = tree.solution();
+		}
+	}
+	if(prm.has_goal){
+		sol = tree.solution();
+	}
+	double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+	cout << "grew " << tree.size() << " nodes in " << secs << " s ("
+		<< (tree.size() - 1)/secs << " nodes/s)" << endl;
+	if(clutter){
+		cout << iters << " extends, " << map.narrow_calls << " GJK calls" << endl;
+	}
+	if(prm.has_goal){
+		if(sol == -1){
+			cout << "goal not reached" << endl;
+		}
+		else {
+			cout << "path cost " << tree.cost[sol] << " (" << tree.path_to(sol).size() << " nodes)" << endl;
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -4,6 +4,12 @@ import sys
 import numpy as np
 import random, time
 
+# compiled planner (rrt_ext.cpp), the pure python one below is the fallback
+try:
+    import rrt_ext
+except ImportError:
+    rrt_ext = None
+
 class Point:
     def __init__(self, x, y):
         self.x = x
@@ -58,7 +64,104 @@ def grow_rrt(S, mindist, maxdist):
     S.append(p_new)
     return p_closest, p_new
 
+# binary tree-growth log written by rrt_planner.cpp --log (see tree_log there)
+# 16 byte header, then fixed 16 byte records: node id now hangs under parent at (x, y)
+LOG_MAGIC = b'RRTL'
+LOG_HEADER_SIZE = 16
+LOG_RECORD = np.dtype([('id', '<i4'), ('parent', '<i4'), ('x', '<f4'), ('y', '<f4')])
+LOG_BATCH = 1 << 16
+
+def read_log_header(f):
+    header = f.read(LOG_HEADER_SIZE)
+    if len(header) < LOG_HEADER_SIZE or header[:4] != LOG_MAGIC:
+        return False
+    version, rec_size, _ = np.frombuffer(header[4:], dtype='<u4')
+    return version == 1 and rec_size == LOG_RECORD.itemsize
+
+def draw_tree(screen, pos, par):
+    screen.fill((0, 0, 0))
+    for c, p in par.items():
+        if p in pos:
+            pygame.draw.line(screen, (128, 100, 0), pos[p], pos[c], 1)
+
+def tail_log(path):
+    # follows the log while the planner is still writing it, drawing whatever
+    # arrived since the last frame in one go. new nodes are just drawn on top,
+    # a rewire or cut (an id seen before) redraws the whole tree
+    pygame.init()
+    screen = pygame.display.set_mode((800, 600))
+    clock = pygame.time.Clock()
+
+    f = open(path, 'rb')
+    while not read_log_header(f):
+        f.seek(0)
+        time.sleep(0.05)
+
+    pos = {}
+    par = {}
+    pending = b''
+    while True:
+        for event in pygame.event.get():
+            if event.type == pygame.QUIT:
+                sys.exit()
+
+        pending += f.read(LOG_BATCH*LOG_RECORD.itemsize)
+        n = len(pending)//LOG_RECORD.itemsize
+        if n == 0:
+            clock.tick(30)
+            continue
+        recs = np.frombuffer(pending[:n*LOG_RECORD.itemsize], dtype=LOG_RECORD)
+        pending = pending[n*LOG_RECORD.itemsize:]
+
+        redraw = False
+        for i, p, x, y in recs.tolist():
+            if i in pos:
+                redraw = True
+            pos[i] = (x, y)
+            if p == -1:
+                par.pop(i, None)
+            else:
+                par[i] = p
+                if not redraw and p in pos:
+                    pygame.draw.line(screen, (128, 100, 0), pos[p], pos[i], 1)
+        if redraw:
+            draw_tree(screen, pos, par)
+        pygame.display.flip()
+
+# growth steps the native planner runs per frame
+NATIVE_STEPS = 256
+
+def native_main():
+    # the planner does the work, python only pulls the new edges out of the
+    # zero-copy node views and draws them
+    pygame.init()
+    screen = pygame.display.set_mode((800, 600))
+
+    planner = rrt_ext.Planner(seed=random.getrandbits(64), maxdist=20)
+    drawn = 1
+    while True:
+        planner.grow(NATIVE_STEPS)
+        pts = np.asarray(planner.points)
+        par = np.asarray(planner.parents)
+        new = range(drawn, len(pts))
+        for p1, p2 in zip(pts[par[new]].tolist(), pts[new].tolist()):
+            pygame.draw.line(screen, (128, 100, 0), p1, p2, 1)
+        drawn = len(pts)
+        # views pin the node arrays, let go before the next grow
+        del pts, par
+        for event in pygame.event.get():
+            if event.type == pygame.QUIT:
+                sys.exit()
+        pygame.display.flip()
+
 def main():
+    if len(sys.argv) > 1:
+        tail_log(sys.argv[1])
+        return
+    if rrt_ext is not None:
+        native_main()
+        return
+
     pygame.init()
     screen = pygame.display.set_mode((800, 600))
 